@@ -0,0 +1,1132 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "disasm8080.h"
+
+/* every opcode once: size, the text up to its operands and its flags.
+ * Both tables below are expanded from this list at compile time */
+#define OPCODES(X) \
+    X(0x00, 1, "NOP", 0) \
+    X(0x01, 3, "LXI\tB,", 0) \
+    X(0x02, 1, "STAX\tB", 0) \
+    X(0x03, 1, "INX\tB", 0) \
+    X(0x04, 1, "INR\tB", 0) \
+    X(0x05, 1, "DCR\tB", 0) \
+    X(0x06, 2, "MVI\tB,", 0) \
+    X(0x07, 1, "RLC", 0) \
+    X(0x08, 1, "NOP", OP_UNDOC) \
+    X(0x09, 1, "DAD\tB", 0) \
+    X(0x0a, 1, "LDAX\tB", 0) \
+    X(0x0b, 1, "DCX\tB", 0) \
+    X(0x0c, 1, "INR\tC", 0) \
+    X(0x0d, 1, "DCR\tC", 0) \
+    X(0x0e, 2, "MVI\tC,", 0) \
+    X(0x0f, 1, "RRC", 0) \
+    X(0x10, 1, "NOP", OP_UNDOC) \
+    X(0x11, 3, "LXI\tD,", 0) \
+    X(0x12, 1, "STAX\tD", 0) \
+    X(0x13, 1, "INX\tD", 0) \
+    X(0x14, 1, "INR\tD", 0) \
+    X(0x15, 1, "DCR\tD", 0) \
+    X(0x16, 2, "MVI\tD,", 0) \
+    X(0x17, 1, "RAL", 0) \
+    X(0x18, 1, "NOP", OP_UNDOC) \
+    X(0x19, 1, "DAD\tD", 0) \
+    X(0x1a, 1, "LDAX\tD", 0) \
+    X(0x1b, 1, "DCX\tD", 0) \
+    X(0x1c, 1, "INR\tE", 0) \
+    X(0x1d, 1, "DCR\tE", 0) \
+    X(0x1e, 2, "MVI\tE,", 0) \
+    X(0x1f, 1, "RAR", 0) \
+    X(0x20, 1, "RIM", OP_UNDOC) /* This is RIM on 8085 systems ... undefined, but functionally "NOP" on 8080 */ \
+    X(0x21, 3, "LXI\tH,", 0) \
+    X(0x22, 3, "SHLD\t", 0) \
+    X(0x23, 1, "INX\tH", 0) \
+    X(0x24, 1, "INR\tH", 0) \
+    X(0x25, 1, "DCR\tH", 0) \
+    X(0x26, 2, "MVI\tH,", 0) \
+    X(0x27, 1, "DAA", 0) \
+    X(0x28, 1, "NOP", OP_UNDOC) /* empty instruction */ \
+    X(0x29, 1, "DAD\tH", 0) \
+    X(0x2a, 3, "LHLD\t", 0) \
+    X(0x2b, 1, "DCX\tH", 0) \
+    X(0x2c, 1, "INR\tL", 0) \
+    X(0x2d, 1, "DCR\tL", 0) \
+    X(0x2e, 2, "MVI\tL,", 0) \
+    X(0x2f, 1, "CMA", 0) /* accumulator complement */ \
+    X(0x30, 1, "SIM", OP_UNDOC) /* SIM instruction on 8085; undefined in 8080 */ \
+    X(0x31, 3, "LXI\tSP,", 0) \
+    X(0x32, 3, "STA\t", 0) \
+    X(0x33, 1, "INX\tSP", 0) \
+    X(0x34, 1, "INR\tM", 0) \
+    X(0x35, 1, "DCR\tM", 0) \
+    X(0x36, 2, "MVI\tM,", 0) \
+    X(0x37, 1, "STC", 0) \
+    X(0x38, 1, "NOP", OP_UNDOC) /* no instruction */ \
+    X(0x39, 1, "DAD\tSP", 0) \
+    X(0x3a, 3, "LDA\t", 0) \
+    X(0x3b, 1, "DCX\tSP", 0) \
+    X(0x3c, 1, "INR\tA", 0) \
+    X(0x3d, 1, "DCR\tA", 0) \
+    X(0x3e, 2, "MVI\tA,", 0) \
+    X(0x3f, 1, "CMC", 0) \
+    X(0x40, 1, "MOV\tB,B", 0) \
+    X(0x41, 1, "MOV\tB,C", 0) \
+    X(0x42, 1, "MOV\tB,D", 0) \
+    X(0x43, 1, "MOV\tB,E", 0) \
+    X(0x44, 1, "MOV\tB,H", 0) \
+    X(0x45, 1, "MOV\tB,L", 0) \
+    X(0x46, 1, "MOV\tB,M", 0) \
+    X(0x47, 1, "MOV\tB,A", 0) \
+    X(0x48, 1, "MOV\tC,B", 0) \
+    X(0x49, 1, "MOV\tC,C", 0) \
+    X(0x4a, 1, "MOV\tC,D", 0) \
+    X(0x4b, 1, "MOV\tC,E", 0) \
+    X(0x4c, 1, "MOV\tC,H", 0) \
+    X(0x4d, 1, "MOV\tC,L", 0) \
+    X(0x4e, 1, "MOV\tC,M", 0) \
+    X(0x4f, 1, "MOV\tC,A", 0) \
+    X(0x50, 1, "MOV\tD,B", 0) \
+    X(0x51, 1, "MOV\tD,C", 0) \
+    X(0x52, 1, "MOV\tD,D", 0) \
+    X(0x53, 1, "MOV\tD,E", 0) \
+    X(0x54, 1, "MOV\tD,H", 0) \
+    X(0x55, 1, "MOV\tD,L", 0) \
+    X(0x56, 1, "MOV\tD,M", 0) \
+    X(0x57, 1, "MOV\tD,A", 0) \
+    X(0x58, 1, "MOV\tE,B", 0) \
+    X(0x59, 1, "MOV\tE,C", 0) \
+    X(0x5a, 1, "MOV\tE,D", 0) \
+    X(0x5b, 1, "MOV\tE,E", 0) \
+    X(0x5c, 1, "MOV\tE,H", 0) \
+    X(0x5d, 1, "MOV\tE,L", 0) \
+    X(0x5e, 1, "MOV\tE,M", 0) \
+    X(0x5f, 1, "MOV\tE,A", 0) \
+    X(0x60, 1, "MOV\tH,B", 0) \
+    X(0x61, 1, "MOV\tH,C", 0) \
+    X(0x62, 1, "MOV\tH,D", 0) \
+    X(0x63, 1, "MOV\tH,E", 0) \
+    X(0x64, 1, "MOV\tH,H", 0) \
+    X(0x65, 1, "MOV\tH,L", 0) \
+    X(0x66, 1, "MOV\tH,M", 0) \
+    X(0x67, 1, "MOV\tH,A", 0) \
+    X(0x68, 1, "MOV\tL,B", 0) \
+    X(0x69, 1, "MOV\tL,C", 0) \
+    X(0x6a, 1, "MOV\tL,D", 0) \
+    X(0x6b, 1, "MOV\tL,E", 0) \
+    X(0x6c, 1, "MOV\tL,H", 0) \
+    X(0x6d, 1, "MOV\tL,L", 0) \
+    X(0x6e, 1, "MOV\tL,M", 0) \
+    X(0x6f, 1, "MOV\tL,A", 0) \
+    X(0x70, 1, "MOV\tM,B", 0) \
+    X(0x71, 1, "MOV\tM,C", 0) \
+    X(0x72, 1, "MOV\tM,D", 0) \
+    X(0x73, 1, "MOV\tM,E", 0) \
+    X(0x74, 1, "MOV\tM,H", 0) \
+    X(0x75, 1, "MOV\tM,L", 0) \
+    X(0x76, 1, "HLT", OP_HALT) /* halt instruction */ \
+    X(0x77, 1, "MOV\tM,A", 0) \
+    X(0x78, 1, "MOV\tA,B", 0) \
+    X(0x79, 1, "MOV\tA,C", 0) \
+    X(0x7a, 1, "MOV\tA,D", 0) \
+    X(0x7b, 1, "MOV\tA,E", 0) \
+    X(0x7c, 1, "MOV\tA,H", 0) \
+    X(0x7d, 1, "MOV\tA,L", 0) \
+    X(0x7e, 1, "MOV\tA,M", 0) \
+    X(0x7f, 1, "MOV\tA,A", 0) \
+    X(0x80, 1, "ADD\tB", 0) \
+    X(0x81, 1, "ADD\tC", 0) \
+    X(0x82, 1, "ADD\tD", 0) \
+    X(0x83, 1, "ADD\tE", 0) \
+    X(0x84, 1, "ADD\tH", 0) \
+    X(0x85, 1, "ADD\tL", 0) \
+    X(0x86, 1, "ADD\tM", 0) \
+    X(0x87, 1, "ADD\tA", 0) \
+    X(0x88, 1, "ADC\tB", 0) \
+    X(0x89, 1, "ADC\tC", 0) \
+    X(0x8a, 1, "ADC\tD", 0) \
+    X(0x8b, 1, "ADC\tE", 0) \
+    X(0x8c, 1, "ADC\tH", 0) \
+    X(0x8d, 1, "ADC\tL", 0) \
+    X(0x8e, 1, "ADC\tM", 0) \
+    X(0x8f, 1, "ADC\tA", 0) \
+    X(0x90, 1, "SUB\tB", 0) \
+    X(0x91, 1, "SUB\tC", 0) \
+    X(0x92, 1, "SUB\tD", 0) \
+    X(0x93, 1, "SUB\tE", 0) \
+    X(0x94, 1, "SUB\tH", 0) \
+    X(0x95, 1, "SUB\tL", 0) \
+    X(0x96, 1, "SUB\tM", 0) \
+    X(0x97, 1, "SUB\tA", 0) \
+    X(0x98, 1, "SBB\tB", 0) \
+    X(0x99, 1, "SBB\tC", 0) \
+    X(0x9a, 1, "SBB\tD", 0) \
+    X(0x9b, 1, "SBB\tE", 0) \
+    X(0x9c, 1, "SBB\tH", 0) \
+    X(0x9d, 1, "SBB\tL", 0) \
+    X(0x9e, 1, "SBB\tM", 0) \
+    X(0x9f, 1, "SBB\tA", 0) \
+    X(0xa0, 1, "ANA\tB", 0) \
+    X(0xa1, 1, "ANA\tC", 0) \
+    X(0xa2, 1, "ANA\tD", 0) \
+    X(0xa3, 1, "ANA\tE", 0) \
+    X(0xa4, 1, "ANA\tH", 0) \
+    X(0xa5, 1, "ANA\tL", 0) \
+    X(0xa6, 1, "ANA\tM", 0) \
+    X(0xa7, 1, "ANA\tA", 0) \
+    X(0xa8, 1, "XRA\tB", 0) \
+    X(0xa9, 1, "XRA\tC", 0) \
+    X(0xaa, 1, "XRA\tD", 0) \
+    X(0xab, 1, "XRA\tE", 0) \
+    X(0xac, 1, "XRA\tH", 0) \
+    X(0xad, 1, "XRA\tL", 0) \
+    X(0xae, 1, "XRA\tM", 0) \
+    X(0xaf, 1, "XRA\tA", 0) \
+    X(0xb0, 1, "ORA\tB", 0) \
+    X(0xb1, 1, "ORA\tC", 0) \
+    X(0xb2, 1, "ORA\tD", 0) \
+    X(0xb3, 1, "ORA\tE", 0) \
+    X(0xb4, 1, "ORA\tH", 0) \
+    X(0xb5, 1, "ORA\tL", 0) \
+    X(0xb6, 1, "ORA\tM", 0) \
+    X(0xb7, 1, "ORA\tA", 0) \
+    X(0xb8, 1, "CMP\tB", 0) \
+    X(0xb9, 1, "CMP\tC", 0) \
+    X(0xba, 1, "CMP\tD", 0) \
+    X(0xbb, 1, "CMP\tE", 0) \
+    X(0xbc, 1, "CMP\tH", 0) \
+    X(0xbd, 1, "CMP\tL", 0) \
+    X(0xbe, 1, "CMP\tM", 0) \
+    X(0xbf, 1, "CMP\tA", 0) \
+    X(0xc0, 1, "RNZ", OP_RET|OP_COND) /* return if not zero */ \
+    X(0xc1, 1, "POP\tB", 0) \
+    X(0xc2, 3, "JNZ\t", OP_JUMP|OP_COND) /* jump if not zero */ \
+    X(0xc3, 3, "JMP\t", OP_JUMP) \
+    X(0xc4, 3, "CNZ\t", OP_CALL|OP_COND) /* call if not zero */ \
+    X(0xc5, 1, "PUSH\tB", 0) \
+    X(0xc6, 2, "ADI\t", 0) /* immediate add */ \
+    X(0xc7, 1, "RST\t0", OP_RST) \
+    X(0xc8, 1, "RZ", OP_RET|OP_COND) /* if zero, return */ \
+    X(0xc9, 1, "RET", OP_RET) /* pop the address off the stack, assign to program counter */ \
+    X(0xca, 3, "JZ\t", OP_JUMP|OP_COND) \
+    X(0xcb, 1, "NOP", OP_UNDOC) /* blank instruction */ \
+    X(0xcc, 3, "CZ\t", OP_CALL|OP_COND) \
+    X(0xcd, 3, "CALL\t", OP_CALL) \
+    X(0xce, 2, "ACI\t", 0) \
+    X(0xcf, 1, "RST\t1", OP_RST) \
+    X(0xd0, 1, "RNC", OP_RET|OP_COND) /* if no carry, return */ \
+    X(0xd1, 1, "POP\tD", 0) \
+    X(0xd2, 3, "JNC\t", OP_JUMP|OP_COND) \
+    X(0xd3, 2, "OUT\t", 0) /* send contents of Accumulator to Output Device #{Byte} */ \
+    X(0xd4, 3, "CNC\t", OP_CALL|OP_COND) /* if no carry, call */ \
+    X(0xd5, 1, "PUSH\tD", 0) \
+    X(0xd6, 2, "SUI\t", 0) /* immediate subtract */ \
+    X(0xd7, 1, "RST\t2", OP_RST) \
+    X(0xd8, 1, "RC", OP_RET|OP_COND) /* if carry, return */ \
+    X(0xd9, 1, "NOP", OP_UNDOC) /* blank instruction */ \
+    X(0xda, 3, "JC\t", OP_JUMP|OP_COND) \
+    X(0xdb, 2, "IN\t", 0) /* read 8 bits of data from Input Device ${Byte} into Accumulator */ \
+    X(0xdc, 3, "CC\t", OP_CALL|OP_COND) \
+    X(0xdd, 1, "NOP", OP_UNDOC) /* blank instruction */ \
+    X(0xde, 2, "SBI\t", 0) /* immediate subtraction with carry */ \
+    X(0xdf, 1, "RST\t3", OP_RST) \
+    X(0xe0, 1, "RPO", OP_RET|OP_COND) /* if PO, return */ \
+    X(0xe1, 1, "POP\tH", 0) \
+    X(0xe2, 3, "JPO\t", OP_JUMP|OP_COND) \
+    X(0xe3, 1, "XTHL", 0) /* exchange stack with the contents of H/L */ \
+    X(0xe4, 3, "CPO\t", OP_CALL|OP_COND) \
+    X(0xe5, 1, "PUSH\tH", 0) \
+    X(0xe6, 2, "ANI\t", 0) \
+    X(0xe7, 1, "RST\t4", OP_RST) \
+    X(0xe8, 1, "RPE", OP_RET|OP_COND) \
+    X(0xe9, 1, "PCHL", OP_JUMP|OP_INDIRECT) \
+    X(0xea, 3, "JPE\t", OP_JUMP|OP_COND) \
+    X(0xeb, 1, "XCHG", 0) \
+    X(0xec, 3, "CPE\t", OP_CALL|OP_COND) \
+    X(0xed, 1, "NOP", OP_UNDOC) /* blank instruction */ \
+    X(0xee, 2, "XRI\t", 0) /* immediate xor */ \
+    X(0xef, 1, "RST\t5", OP_RST) \
+    X(0xf0, 1, "RP", OP_RET|OP_COND) /* if P, return */ \
+    X(0xf1, 1, "POP\tPSW", 0) \
+    X(0xf2, 3, "JP\t", OP_JUMP|OP_COND) \
+    X(0xf3, 1, "DI", 0) \
+    X(0xf4, 3, "CP\t", OP_CALL|OP_COND) \
+    X(0xf5, 1, "PUSH\tPSW", 0) \
+    X(0xf6, 2, "ORI\t", 0) /* immediate or */ \
+    X(0xf7, 1, "RST\t6", OP_RST) \
+    X(0xf8, 1, "RM", OP_RET|OP_COND) /* if M, return */ \
+    X(0xf9, 1, "SPHL", 0) \
+    X(0xfa, 3, "JM\t", OP_JUMP|OP_COND) \
+    X(0xfb, 1, "EI", 0) \
+    X(0xfc, 3, "CM\t", OP_CALL|OP_COND) \
+    X(0xfd, 1, "NOP", OP_UNDOC) /* blank instruction */ \
+    X(0xfe, 2, "CPI\t", 0) \
+    X(0xff, 1, "RST\t7", OP_RST) \
+
+/* the operand templates are appended at compile time, so the text and
+ * the printf form of an entry can never disagree */
+#define OP1(text, flags) { text, text, 1, sizeof(text) - 1, flags }
+#define OP2(text, flags) { text "%02x", text, 2, sizeof(text) - 1, flags }
+#define OP3(text, flags) { text "%02x%02x", text, 3, sizeof(text) - 1, flags }
+#define OP_ENTRY(code, size, text, flags) [code] = OP##size(text, flags),
+
+/* one entry per opcode; decoding is a single indexed load */
+_Alignas(64) const Op disasm_ops[256] = {
+    OPCODES(OP_ENTRY)
+};
+
+#define ATTR(size, flags) ((size) \
+        | ((flags) & OP_JUMP ? ATTR_JUMP : 0) \
+        | ((flags) & (OP_CALL | OP_RST) ? ATTR_CALL : 0) \
+        | ((flags) & OP_RET ? ATTR_RET : 0) \
+        | ((flags) & OP_HALT || ((flags) & (OP_JUMP | OP_RET) && !((flags) & OP_COND)) ? ATTR_STOP : 0) \
+        | ((flags) & OP_UNDOC ? ATTR_UNDOC : 0) \
+        | ((size) == 3 ? ATTR_ADDR : 0))
+#define ATTR_ENTRY(code, size, text, flags) [code] = ATTR(size, flags),
+
+/* the same table squeezed to one byte per opcode, a cache line in four */
+_Alignas(64) const uint8_t disasm_attrs[256] = {
+    OPCODES(ATTR_ENTRY)
+};
+
+Op Disassemble(uint8_t opcode) {
+    return disasm_ops[opcode];
+}
+
+void ClassifyBytes(const uint8_t* data, size_t n, uint8_t* attrs) {
+    for (size_t i = 0; i < n; ++i)
+        attrs[i] = disasm_attrs[data[i]];
+}
+
+size_t DecodeRange(const DisasmContext* ctx, size_t start, size_t end, Insn* out, size_t max, size_t* next) {
+    const size_t image_end = ctx->base + ctx->size;
+    if (end > image_end)
+        end = image_end;
+    size_t address = start;
+    size_t n = 0;
+    for (; address < end && n < max; address += out[n++].size) {
+        const uint8_t* bytes = ctx->data + (address - ctx->base);
+        uint8_t tail[3] = {0};
+        if (address + disasm_ops[bytes[0]].size > image_end) {
+            memcpy(tail, bytes, image_end - address);
+            bytes = tail;
+        }
+        DecodeInsn(&out[n], address, bytes);
+    }
+    if (next)
+        *next = address;
+    return n;
+}
+
+/* the same opcodes in Zilog mnemonics: size, text up to the operand and
+ * text after it */
+#define Z80_OPCODES(X) \
+    X(0x00, 1, "NOP", "") \
+    X(0x01, 3, "LD\tBC,$", "") \
+    X(0x02, 1, "LD\t(BC),A", "") \
+    X(0x03, 1, "INC\tBC", "") \
+    X(0x04, 1, "INC\tB", "") \
+    X(0x05, 1, "DEC\tB", "") \
+    X(0x06, 2, "LD\tB,$", "") \
+    X(0x07, 1, "RLCA", "") \
+    X(0x08, 1, "NOP", "") \
+    X(0x09, 1, "ADD\tHL,BC", "") \
+    X(0x0a, 1, "LD\tA,(BC)", "") \
+    X(0x0b, 1, "DEC\tBC", "") \
+    X(0x0c, 1, "INC\tC", "") \
+    X(0x0d, 1, "DEC\tC", "") \
+    X(0x0e, 2, "LD\tC,$", "") \
+    X(0x0f, 1, "RRCA", "") \
+    X(0x10, 1, "NOP", "") \
+    X(0x11, 3, "LD\tDE,$", "") \
+    X(0x12, 1, "LD\t(DE),A", "") \
+    X(0x13, 1, "INC\tDE", "") \
+    X(0x14, 1, "INC\tD", "") \
+    X(0x15, 1, "DEC\tD", "") \
+    X(0x16, 2, "LD\tD,$", "") \
+    X(0x17, 1, "RLA", "") \
+    X(0x18, 1, "NOP", "") \
+    X(0x19, 1, "ADD\tHL,DE", "") \
+    X(0x1a, 1, "LD\tA,(DE)", "") \
+    X(0x1b, 1, "DEC\tDE", "") \
+    X(0x1c, 1, "INC\tE", "") \
+    X(0x1d, 1, "DEC\tE", "") \
+    X(0x1e, 2, "LD\tE,$", "") \
+    X(0x1f, 1, "RRA", "") \
+    X(0x20, 1, "RIM", "") \
+    X(0x21, 3, "LD\tHL,$", "") \
+    X(0x22, 3, "LD\t($", "),HL") \
+    X(0x23, 1, "INC\tHL", "") \
+    X(0x24, 1, "INC\tH", "") \
+    X(0x25, 1, "DEC\tH", "") \
+    X(0x26, 2, "LD\tH,$", "") \
+    X(0x27, 1, "DAA", "") \
+    X(0x28, 1, "NOP", "") \
+    X(0x29, 1, "ADD\tHL,HL", "") \
+    X(0x2a, 3, "LD\tHL,($", ")") \
+    X(0x2b, 1, "DEC\tHL", "") \
+    X(0x2c, 1, "INC\tL", "") \
+    X(0x2d, 1, "DEC\tL", "") \
+    X(0x2e, 2, "LD\tL,$", "") \
+    X(0x2f, 1, "CPL", "") \
+    X(0x30, 1, "SIM", "") \
+    X(0x31, 3, "LD\tSP,$", "") \
+    X(0x32, 3, "LD\t($", "),A") \
+    X(0x33, 1, "INC\tSP", "") \
+    X(0x34, 1, "INC\t(HL)", "") \
+    X(0x35, 1, "DEC\t(HL)", "") \
+    X(0x36, 2, "LD\t(HL),$", "") \
+    X(0x37, 1, "SCF", "") \
+    X(0x38, 1, "NOP", "") \
+    X(0x39, 1, "ADD\tHL,SP", "") \
+    X(0x3a, 3, "LD\tA,($", ")") \
+    X(0x3b, 1, "DEC\tSP", "") \
+    X(0x3c, 1, "INC\tA", "") \
+    X(0x3d, 1, "DEC\tA", "") \
+    X(0x3e, 2, "LD\tA,$", "") \
+    X(0x3f, 1, "CCF", "") \
+    X(0x40, 1, "LD\tB,B", "") \
+    X(0x41, 1, "LD\tB,C", "") \
+    X(0x42, 1, "LD\tB,D", "") \
+    X(0x43, 1, "LD\tB,E", "") \
+    X(0x44, 1, "LD\tB,H", "") \
+    X(0x45, 1, "LD\tB,L", "") \
+    X(0x46, 1, "LD\tB,(HL)", "") \
+    X(0x47, 1, "LD\tB,A", "") \
+    X(0x48, 1, "LD\tC,B", "") \
+    X(0x49, 1, "LD\tC,C", "") \
+    X(0x4a, 1, "LD\tC,D", "") \
+    X(0x4b, 1, "LD\tC,E", "") \
+    X(0x4c, 1, "LD\tC,H", "") \
+    X(0x4d, 1, "LD\tC,L", "") \
+    X(0x4e, 1, "LD\tC,(HL)", "") \
+    X(0x4f, 1, "LD\tC,A", "") \
+    X(0x50, 1, "LD\tD,B", "") \
+    X(0x51, 1, "LD\tD,C", "") \
+    X(0x52, 1, "LD\tD,D", "") \
+    X(0x53, 1, "LD\tD,E", "") \
+    X(0x54, 1, "LD\tD,H", "") \
+    X(0x55, 1, "LD\tD,L", "") \
+    X(0x56, 1, "LD\tD,(HL)", "") \
+    X(0x57, 1, "LD\tD,A", "") \
+    X(0x58, 1, "LD\tE,B", "") \
+    X(0x59, 1, "LD\tE,C", "") \
+    X(0x5a, 1, "LD\tE,D", "") \
+    X(0x5b, 1, "LD\tE,E", "") \
+    X(0x5c, 1, "LD\tE,H", "") \
+    X(0x5d, 1, "LD\tE,L", "") \
+    X(0x5e, 1, "LD\tE,(HL)", "") \
+    X(0x5f, 1, "LD\tE,A", "") \
+    X(0x60, 1, "LD\tH,B", "") \
+    X(0x61, 1, "LD\tH,C", "") \
+    X(0x62, 1, "LD\tH,D", "") \
+    X(0x63, 1, "LD\tH,E", "") \
+    X(0x64, 1, "LD\tH,H", "") \
+    X(0x65, 1, "LD\tH,L", "") \
+    X(0x66, 1, "LD\tH,(HL)", "") \
+    X(0x67, 1, "LD\tH,A", "") \
+    X(0x68, 1, "LD\tL,B", "") \
+    X(0x69, 1, "LD\tL,C", "") \
+    X(0x6a, 1, "LD\tL,D", "") \
+    X(0x6b, 1, "LD\tL,E", "") \
+    X(0x6c, 1, "LD\tL,H", "") \
+    X(0x6d, 1, "LD\tL,L", "") \
+    X(0x6e, 1, "LD\tL,(HL)", "") \
+    X(0x6f, 1, "LD\tL,A", "") \
+    X(0x70, 1, "LD\t(HL),B", "") \
+    X(0x71, 1, "LD\t(HL),C", "") \
+    X(0x72, 1, "LD\t(HL),D", "") \
+    X(0x73, 1, "LD\t(HL),E", "") \
+    X(0x74, 1, "LD\t(HL),H", "") \
+    X(0x75, 1, "LD\t(HL),L", "") \
+    X(0x76, 1, "HALT", "") \
+    X(0x77, 1, "LD\t(HL),A", "") \
+    X(0x78, 1, "LD\tA,B", "") \
+    X(0x79, 1, "LD\tA,C", "") \
+    X(0x7a, 1, "LD\tA,D", "") \
+    X(0x7b, 1, "LD\tA,E", "") \
+    X(0x7c, 1, "LD\tA,H", "") \
+    X(0x7d, 1, "LD\tA,L", "") \
+    X(0x7e, 1, "LD\tA,(HL)", "") \
+    X(0x7f, 1, "LD\tA,A", "") \
+    X(0x80, 1, "ADD\tA,B", "") \
+    X(0x81, 1, "ADD\tA,C", "") \
+    X(0x82, 1, "ADD\tA,D", "") \
+    X(0x83, 1, "ADD\tA,E", "") \
+    X(0x84, 1, "ADD\tA,H", "") \
+    X(0x85, 1, "ADD\tA,L", "") \
+    X(0x86, 1, "ADD\tA,(HL)", "") \
+    X(0x87, 1, "ADD\tA,A", "") \
+    X(0x88, 1, "ADC\tA,B", "") \
+    X(0x89, 1, "ADC\tA,C", "") \
+    X(0x8a, 1, "ADC\tA,D", "") \
+    X(0x8b, 1, "ADC\tA,E", "") \
+    X(0x8c, 1, "ADC\tA,H", "") \
+    X(0x8d, 1, "ADC\tA,L", "") \
+    X(0x8e, 1, "ADC\tA,(HL)", "") \
+    X(0x8f, 1, "ADC\tA,A", "") \
+    X(0x90, 1, "SUB\tB", "") \
+    X(0x91, 1, "SUB\tC", "") \
+    X(0x92, 1, "SUB\tD", "") \
+    X(0x93, 1, "SUB\tE", "") \
+    X(0x94, 1, "SUB\tH", "") \
+    X(0x95, 1, "SUB\tL", "") \
+    X(0x96, 1, "SUB\t(HL)", "") \
+    X(0x97, 1, "SUB\tA", "") \
+    X(0x98, 1, "SBC\tA,B", "") \
+    X(0x99, 1, "SBC\tA,C", "") \
+    X(0x9a, 1, "SBC\tA,D", "") \
+    X(0x9b, 1, "SBC\tA,E", "") \
+    X(0x9c, 1, "SBC\tA,H", "") \
+    X(0x9d, 1, "SBC\tA,L", "") \
+    X(0x9e, 1, "SBC\tA,(HL)", "") \
+    X(0x9f, 1, "SBC\tA,A", "") \
+    X(0xa0, 1, "AND\tB", "") \
+    X(0xa1, 1, "AND\tC", "") \
+    X(0xa2, 1, "AND\tD", "") \
+    X(0xa3, 1, "AND\tE", "") \
+    X(0xa4, 1, "AND\tH", "") \
+    X(0xa5, 1, "AND\tL", "") \
+    X(0xa6, 1, "AND\t(HL)", "") \
+    X(0xa7, 1, "AND\tA", "") \
+    X(0xa8, 1, "XOR\tB", "") \
+    X(0xa9, 1, "XOR\tC", "") \
+    X(0xaa, 1, "XOR\tD", "") \
+    X(0xab, 1, "XOR\tE", "") \
+    X(0xac, 1, "XOR\tH", "") \
+    X(0xad, 1, "XOR\tL", "") \
+    X(0xae, 1, "XOR\t(HL)", "") \
+    X(0xaf, 1, "XOR\tA", "") \
+    X(0xb0, 1, "OR\tB", "") \
+    X(0xb1, 1, "OR\tC", "") \
+    X(0xb2, 1, "OR\tD", "") \
+    X(0xb3, 1, "OR\tE", "") \
+    X(0xb4, 1, "OR\tH", "") \
+    X(0xb5, 1, "OR\tL", "") \
+    X(0xb6, 1, "OR\t(HL)", "") \
+    X(0xb7, 1, "OR\tA", "") \
+    X(0xb8, 1, "CP\tB", "") \
+    X(0xb9, 1, "CP\tC", "") \
+    X(0xba, 1, "CP\tD", "") \
+    X(0xbb, 1, "CP\tE", "") \
+    X(0xbc, 1, "CP\tH", "") \
+    X(0xbd, 1, "CP\tL", "") \
+    X(0xbe, 1, "CP\t(HL)", "") \
+    X(0xbf, 1, "CP\tA", "") \
+    X(0xc0, 1, "RET\tNZ", "") \
+    X(0xc1, 1, "POP\tBC", "") \
+    X(0xc2, 3, "JP\tNZ,$", "") \
+    X(0xc3, 3, "JP\t$", "") \
+    X(0xc4, 3, "CALL\tNZ,$", "") \
+    X(0xc5, 1, "PUSH\tBC", "") \
+    X(0xc6, 2, "ADD\tA,$", "") \
+    X(0xc7, 1, "RST\t$00", "") \
+    X(0xc8, 1, "RET\tZ", "") \
+    X(0xc9, 1, "RET", "") \
+    X(0xca, 3, "JP\tZ,$", "") \
+    X(0xcb, 1, "NOP", "") \
+    X(0xcc, 3, "CALL\tZ,$", "") \
+    X(0xcd, 3, "CALL\t$", "") \
+    X(0xce, 2, "ADC\tA,$", "") \
+    X(0xcf, 1, "RST\t$08", "") \
+    X(0xd0, 1, "RET\tNC", "") \
+    X(0xd1, 1, "POP\tDE", "") \
+    X(0xd2, 3, "JP\tNC,$", "") \
+    X(0xd3, 2, "OUT\t($", "),A") \
+    X(0xd4, 3, "CALL\tNC,$", "") \
+    X(0xd5, 1, "PUSH\tDE", "") \
+    X(0xd6, 2, "SUB\t$", "") \
+    X(0xd7, 1, "RST\t$10", "") \
+    X(0xd8, 1, "RET\tC", "") \
+    X(0xd9, 1, "NOP", "") \
+    X(0xda, 3, "JP\tC,$", "") \
+    X(0xdb, 2, "IN\tA,($", ")") \
+    X(0xdc, 3, "CALL\tC,$", "") \
+    X(0xdd, 1, "NOP", "") \
+    X(0xde, 2, "SBC\tA,$", "") \
+    X(0xdf, 1, "RST\t$18", "") \
+    X(0xe0, 1, "RET\tPO", "") \
+    X(0xe1, 1, "POP\tHL", "") \
+    X(0xe2, 3, "JP\tPO,$", "") \
+    X(0xe3, 1, "EX\t(SP),HL", "") \
+    X(0xe4, 3, "CALL\tPO,$", "") \
+    X(0xe5, 1, "PUSH\tHL", "") \
+    X(0xe6, 2, "AND\t$", "") \
+    X(0xe7, 1, "RST\t$20", "") \
+    X(0xe8, 1, "RET\tPE", "") \
+    X(0xe9, 1, "JP\t(HL)", "") \
+    X(0xea, 3, "JP\tPE,$", "") \
+    X(0xeb, 1, "EX\tDE,HL", "") \
+    X(0xec, 3, "CALL\tPE,$", "") \
+    X(0xed, 1, "NOP", "") \
+    X(0xee, 2, "XOR\t$", "") \
+    X(0xef, 1, "RST\t$28", "") \
+    X(0xf0, 1, "RET\tP", "") \
+    X(0xf1, 1, "POP\tAF", "") \
+    X(0xf2, 3, "JP\tP,$", "") \
+    X(0xf3, 1, "DI", "") \
+    X(0xf4, 3, "CALL\tP,$", "") \
+    X(0xf5, 1, "PUSH\tAF", "") \
+    X(0xf6, 2, "OR\t$", "") \
+    X(0xf7, 1, "RST\t$30", "") \
+    X(0xf8, 1, "RET\tM", "") \
+    X(0xf9, 1, "LD\tSP,HL", "") \
+    X(0xfa, 3, "JP\tM,$", "") \
+    X(0xfb, 1, "EI", "") \
+    X(0xfc, 3, "CALL\tM,$", "") \
+    X(0xfd, 1, "NOP", "") \
+    X(0xfe, 2, "CP\t$", "") \
+    X(0xff, 1, "RST\t$38", "")
+
+/* padding that keeps every head and tail readable for the fixed-size
+ * copies in FormatWith() */
+#define PAD16(s) s "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+#define PAD8(s) s "\0\0\0\0\0\0\0"
+#define SYNTAX_OP(head, operand, tail, prefix, suffix) \
+        { PAD16(head), PAD8(tail), sizeof(head) - 1, sizeof(tail) - 1, operand, prefix, suffix }
+
+#define INTEL_ENTRY(code, size, text, flags) [code] = SYNTAX_OP(text, (size) - 1, "", 0, 0),
+#define Z80_ENTRY(code, size, head, tail) [code] = SYNTAX_OP(head, (size) - 1, tail, (size) > 1, 0),
+/* numbers get a leading 0 and an h so they never read as a name */
+#define ASM_UNDOC(flags) ((flags) & OP_UNDOC)
+#define ASM_ENTRY(code, size, text, flags) [code] = { \
+        ASM_UNDOC(flags) ? PAD16("DB\t0") : (size) > 1 ? PAD16(text "0") : PAD16(text), \
+        ASM_UNDOC(flags) || (size) > 1 ? PAD8("h") : PAD8(""), \
+        ASM_UNDOC(flags) ? 4 : sizeof(text) - 1 + ((size) > 1), \
+        ASM_UNDOC(flags) || (size) > 1, \
+        ASM_UNDOC(flags) ? SYNTAX_OPCODE : (size) - 1, \
+        ASM_UNDOC(flags) || (size) > 1, \
+        ASM_UNDOC(flags) || (size) > 1 },
+
+static const SyntaxOp intel_ops[256] = {
+    OPCODES(INTEL_ENTRY)
+};
+
+static const SyntaxOp z80_ops[256] = {
+    Z80_OPCODES(Z80_ENTRY)
+};
+
+static const SyntaxOp asm_ops[256] = {
+    OPCODES(ASM_ENTRY)
+};
+
+const SyntaxOp* const disasm_syntax[SYNTAX_COUNT] = {intel_ops, z80_ops, asm_ops};
+const char* const disasm_syntax_names[SYNTAX_COUNT] = {"intel", "z80", "asm"};
+
+/* how DB lines write a byte in each syntax */
+static const struct {
+    const char* prefix;
+    const char* suffix;
+} data_numbers[SYNTAX_COUNT] = {{"", ""}, {"$", ""}, {"0", "h"}};
+
+/* two lowercase hex digits for every byte value, so the emitter can
+ * render operands with a single copy instead of going through printf */
+const char disasm_hex_pairs[513] =
+        "000102030405060708090a0b0c0d0e0f"
+        "101112131415161718191a1b1c1d1e1f"
+        "202122232425262728292a2b2c2d2e2f"
+        "303132333435363738393a3b3c3d3e3f"
+        "404142434445464748494a4b4c4d4e4f"
+        "505152535455565758595a5b5c5d5e5f"
+        "606162636465666768696a6b6c6d6e6f"
+        "707172737475767778797a7b7c7d7e7f"
+        "808182838485868788898a8b8c8d8e8f"
+        "909192939495969798999a9b9c9d9e9f"
+        "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+        "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+        "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+        "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+        "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+        "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* the formatter every syntax is stamped out from. ops, high_first and
+ * tails are constants at each call site, so each copy only does the work
+ * its syntax needs: Intel never looks at a tail */
+static inline __attribute__((always_inline))
+size_t FormatWith(char* out, const Insn* insn, const SyntaxOp* ops, int high_first, int tails) {
+    const SyntaxOp* op = &ops[insn->opcode];
+    char* p = DisasmPutAddress(out, insn->address);
+    memcpy(p, op->head, 16);
+    p += op->head_len;
+    switch (op->operand) {
+        case SYNTAX_BYTE:
+            p = DisasmPutHex(p, insn->operand & 0xff);
+            break;
+        case SYNTAX_WORD:
+            if (high_first) {
+                p = DisasmPutHex(p, insn->operand >> 8);
+                p = DisasmPutHex(p, insn->operand & 0xff);
+            } else {
+                p = DisasmPutHex(p, insn->operand & 0xff);
+                p = DisasmPutHex(p, insn->operand >> 8);
+            }
+            break;
+        case SYNTAX_OPCODE:
+            p = DisasmPutHex(p, insn->opcode);
+            break;
+    }
+    if (tails) {
+        memcpy(p, op->tail, 8);
+        p += op->tail_len;
+    }
+    *p++ = '\n';
+    return p - out;
+}
+
+size_t FormatInsn(char* out, const Insn* insn) {
+    return FormatWith(out, insn, intel_ops, 0, 0);
+}
+
+size_t FormatInsnZ80(char* out, const Insn* insn) {
+    return FormatWith(out, insn, z80_ops, 1, 1);
+}
+
+size_t FormatInsnAsm(char* out, const Insn* insn) {
+    return FormatWith(out, insn, asm_ops, 1, 1);
+}
+
+const DisasmFormatter disasm_formatters[SYNTAX_COUNT] = {FormatInsn, FormatInsnZ80, FormatInsnAsm};
+
+size_t FormatDataSyntax(char* out, int syntax, size_t address, const uint8_t* bytes, size_t n) {
+    const char* prefix = data_numbers[syntax].prefix;
+    const char* suffix = data_numbers[syntax].suffix;
+    char* p = DisasmPutAddress(out, address);
+    memcpy(p, "DB\t", 3);
+    p += 3;
+    for (size_t i = 0; i < n; ++i) {
+        if (i)
+            *p++ = ',';
+        for (const char* c = prefix; *c; ++c)
+            *p++ = *c;
+        p = DisasmPutHex(p, bytes[i]);
+        for (const char* c = suffix; *c; ++c)
+            *p++ = *c;
+    }
+    *p++ = '\n';
+    return p - out;
+}
+
+size_t FormatData(char* out, size_t address, const uint8_t* bytes, size_t n) {
+    return FormatDataSyntax(out, SYNTAX_INTEL, address, bytes, n);
+}
+
+/* DisasmRange() for one syntax; the formatter is inlined into the loop */
+static inline __attribute__((always_inline))
+int RangeWith(const DisasmContext* ctx, size_t start, size_t end, const SyntaxOp* ops, int high_first, int tails) {
+    const size_t image_end = ctx->base + ctx->size;
+    if (end > image_end)
+        end = image_end;
+    char buf[0x4000];
+    size_t len = 0;
+    Insn insn;
+    for (size_t address = start; address < end; address += insn.size) {
+        if (len > sizeof(buf) - DISASM_LINE_MAX) {
+            int status = ctx->write(ctx->user, buf, len);
+            if (status)
+                return status;
+            len = 0;
+        }
+        const uint8_t* bytes = ctx->data + (address - ctx->base);
+        uint8_t tail[3] = {0};
+        if (address + 3 > image_end) {
+            memcpy(tail, bytes, image_end - address < 3 ? image_end - address : 3);
+            bytes = tail;
+        }
+        DecodeInsn(&insn, address, bytes);
+        len += FormatWith(buf + len, &insn, ops, high_first, tails);
+    }
+    return len ? ctx->write(ctx->user, buf, len) : 0;
+}
+
+int DisasmRange(const DisasmContext* ctx, size_t start, size_t end) {
+    switch (ctx->syntax) {
+        case SYNTAX_Z80:
+            return RangeWith(ctx, start, end, z80_ops, 1, 1);
+        case SYNTAX_ASM:
+            return RangeWith(ctx, start, end, asm_ops, 1, 1);
+        default:
+            return RangeWith(ctx, start, end, intel_ops, 0, 0);
+    }
+}
+
+/*
+ * data regions. The bytes go past 64 at a time as bit masks, one bit per
+ * byte: printable, part of a word (letter, digit or space), space, equal
+ * to the byte before, and the word there following on from the word two
+ * bytes back as the next entry of a table. Strings and fills are runs of
+ * set bits, followed with count-trailing-zeros; tables are chains of
+ * links, one for each parity, so only the few words that pass the mask
+ * are looked at one by one. Candidates of different kinds can overlap,
+ * so they are sorted and settled once at the end
+ */
+#define FILL_MIN     16
+#define STRING_MIN   8  /* with a space in it */
+#define STRING_LONG  16 /* without one */
+#define TABLE_MIN    6  /* words */
+#define TABLE_SPREAD 8  /* pages an entry of a table may stray from the one before */
+
+enum {
+    MASK_PRINT,
+    MASK_WORD,
+    MASK_SPACE,
+    MASK_SAME,
+    MASK_LINK,
+    MASK_COUNT,
+};
+
+/* the pages of the image; the high byte of every entry of a table is in
+ * [lo, hi] */
+typedef struct {
+    uint8_t lo;
+    uint8_t hi;
+} Pages;
+
+#ifdef __SSE2__
+/* lo <= v <= hi for unsigned bytes */
+static inline __m128i InRange(__m128i v, uint8_t lo, uint8_t hi) {
+    const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+/* w[-1] and w[64] are the bytes either side of w[0..63] */
+static void RegionMasksSse2(const uint8_t* w, Pages pages, uint64_t* masks) {
+    memset(masks, 0, MASK_COUNT * sizeof(uint64_t));
+    for (int k = 0; k < 4; ++k) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(w + 16 * k));
+        const __m128i prev = _mm_loadu_si128((const __m128i*)(w + 16 * k - 1));
+        const __m128i next = _mm_loadu_si128((const __m128i*)(w + 16 * k + 1));
+        const __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        const __m128i control = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        const __m128i letter = InRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        const __m128i word = _mm_or_si128(space, _mm_or_si128(letter, InRange(v, '0', '9')));
+        /* the high bytes of the word here and of the one two bytes back */
+        const __m128i apart = _mm_or_si128(_mm_subs_epu8(next, prev), _mm_subs_epu8(prev, next));
+        const __m128i link = _mm_and_si128(InRange(apart, 0, TABLE_SPREAD),
+                                           _mm_and_si128(InRange(next, pages.lo, pages.hi),
+                                                         InRange(prev, pages.lo, pages.hi)));
+        const int shift = 16 * k;
+        masks[MASK_PRINT] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(InRange(v, 0x20, 0x7e), control))
+                << shift;
+        masks[MASK_WORD] |= (uint64_t)(uint16_t)_mm_movemask_epi8(word) << shift;
+        masks[MASK_SPACE] |= (uint64_t)(uint16_t)_mm_movemask_epi8(space) << shift;
+        masks[MASK_SAME] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, prev)) << shift;
+        masks[MASK_LINK] |= (uint64_t)(uint16_t)_mm_movemask_epi8(link) << shift;
+    }
+}
+#define RegionMasks RegionMasksSse2
+#else
+/* w[-1] and w[64] are the bytes either side of w[0..63] */
+static void RegionMasksScalar(const uint8_t* w, Pages pages, uint64_t* masks) {
+    memset(masks, 0, MASK_COUNT * sizeof(uint64_t));
+    for (int i = 0; i < 64; ++i) {
+        const uint8_t c = w[i];
+        const uint8_t lower = c | 0x20;
+        const uint8_t high = w[i + 1];
+        const uint8_t high_before = w[i - 1];
+        const uint64_t bit = 1ull << i;
+        if ((c >= 0x20 && c <= 0x7e) || c == '\t' || c == '\n' || c == '\r')
+            masks[MASK_PRINT] |= bit;
+        if (c == ' ' || (c >= '0' && c <= '9') || (lower >= 'a' && lower <= 'z'))
+            masks[MASK_WORD] |= bit;
+        if (c == ' ')
+            masks[MASK_SPACE] |= bit;
+        if (c == high_before)
+            masks[MASK_SAME] |= bit;
+        if ((high > high_before ? high - high_before : high_before - high) <= TABLE_SPREAD && high >= pages.lo
+            && high <= pages.hi && high_before >= pages.lo && high_before <= pages.hi)
+            masks[MASK_LINK] |= bit;
+    }
+}
+#define RegionMasks RegionMasksScalar
+#endif
+
+typedef struct {
+    int open;
+    size_t start;
+    size_t words;
+    size_t spaces;
+} Run;
+
+typedef struct {
+    size_t start;
+    size_t end;
+    size_t words;
+    size_t spaces;
+} RunEnd;
+
+/* carry a run of set bits across one chunk of mask at address, storing
+ * every run of at least min bits that ends inside it. Shorter runs are
+ * never stored, so their bits are not counted either */
+static size_t RunStep(Run* r, uint64_t mask, uint64_t words, uint64_t spaces, size_t address, size_t min,
+                      RunEnd* ended) {
+    size_t n = 0;
+    unsigned pos = 0;
+    while (pos < 64) {
+        const uint64_t rest = mask >> pos;
+        if (!r->open) {
+            if (!rest)
+                break;
+            pos += __builtin_ctzll(rest);
+            *r = (Run){.open = 1, .start = address + pos};
+            continue;
+        }
+        const uint64_t full = ~0ull >> pos;
+        const unsigned len = rest == full ? 64 - pos : (unsigned)__builtin_ctzll(~rest);
+        const int stored = rest == full || address + pos + len - r->start >= min;
+        if (stored && (words | spaces)) {
+            const uint64_t span = (len == 64 ? ~0ull : (1ull << len) - 1) << pos;
+            r->words += __builtin_popcountll(words & span);
+            r->spaces += __builtin_popcountll(spaces & span);
+        }
+        pos += len;
+        if (rest == full)
+            break;
+        if (stored)
+            ended[n++] = (RunEnd){r->start, address + pos, r->words, r->spaces};
+        r->open = 0;
+    }
+    return n;
+}
+
+typedef struct {
+    size_t start;
+    size_t count;
+} Chain;
+
+typedef struct {
+    DataRegion* out;
+    size_t max;
+    size_t n;
+} Candidates;
+
+static void AddCandidate(Candidates* c, size_t start, size_t end, uint8_t kind, uint8_t fill) {
+    if (c->n < c->max)
+        c->out[c->n++] = (DataRegion){.start = start, .end = end, .kind = kind, .fill = fill};
+}
+
+static void EndString(Candidates* c, const RunEnd* run) {
+    const size_t len = run->end - run->start;
+    if (run->words * 3 >= len * 2 && ((len >= STRING_MIN && run->spaces) || len >= STRING_LONG))
+        AddCandidate(c, run->start, run->end, REGION_STRING, 0);
+}
+
+static void EndFill(Candidates* c, const RunEnd* run, const DisasmContext* ctx) {
+    /* the run marks bytes equal to the one before, which starts the fill */
+    if (run->end - run->start + 1 >= FILL_MIN)
+        AddCandidate(c, run->start - 1, run->end, REGION_FILL, ctx->data[run->start - 1 - ctx->base]);
+}
+
+static void EndChain(Candidates* c, Chain* chain) {
+    if (chain->count >= TABLE_MIN)
+        AddCandidate(c, chain->start, chain->start + 2 * chain->count, REGION_TABLE, 0);
+    chain->count = 0;
+}
+
+static int RegionLongEnough(uint8_t kind, size_t len) {
+    switch (kind) {
+        case REGION_FILL:
+            return len >= FILL_MIN;
+        case REGION_TABLE:
+            return len >= 2 * TABLE_MIN;
+        default:
+            return len >= STRING_MIN;
+    }
+}
+
+/* which kind wins where two overlap */
+static int RegionRank(uint8_t kind) {
+    return kind == REGION_FILL ? 3 : kind == REGION_STRING ? 2 : 1;
+}
+
+static int CompareRegions(const void* a, const void* b) {
+    const DataRegion* x = a;
+    const DataRegion* y = b;
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return RegionRank(y->kind) - RegionRank(x->kind);
+}
+
+/* sort the candidates and cut every overlap in favour of the higher
+ * rank, dropping what gets too short; tables are only cut by words */
+static size_t SettleRegions(DataRegion* r, size_t n) {
+    qsort(r, n, sizeof(DataRegion), CompareRegions);
+    size_t kept = 0;
+    for (size_t i = 0; i < n; ++i) {
+        DataRegion next = r[i];
+        while (kept && next.start < r[kept - 1].end) {
+            DataRegion* last = &r[kept - 1];
+            if (RegionRank(next.kind) > RegionRank(last->kind)) {
+                last->end = last->kind == REGION_TABLE ? last->start + ((next.start - last->start) & ~(size_t)1)
+                                                       : next.start;
+                if (!RegionLongEnough(last->kind, last->end - last->start))
+                    --kept;
+                continue;
+            }
+            next.start = next.kind == REGION_TABLE ? next.start + ((last->end - next.start + 1) & ~(size_t)1)
+                                                   : last->end;
+            break;
+        }
+        if (next.start < next.end && RegionLongEnough(next.kind, next.end - next.start))
+            r[kept++] = next;
+    }
+    return kept;
+}
+
+static inline int InImage(const DisasmContext* ctx, uint16_t word) {
+    return word && word >= ctx->base && word < ctx->base + ctx->size;
+}
+
+size_t FindDataRegions(const DisasmContext* ctx, size_t start, size_t end, DataRegion* out, size_t max) {
+    const size_t image_end = ctx->base + ctx->size;
+    if (end > image_end)
+        end = image_end;
+    if (start >= end)
+        return 0;
+    /* an image past the 16-bit address space has no page of its own to
+     * point at, and gets an empty range */
+    const Pages pages = ctx->base > 0xffff ? (Pages){1, 0}
+                                           : (Pages){ctx->base >> 8, image_end > 0xffff ? 0xff : (image_end - 1) >> 8};
+    Candidates c = {out, max, 0};
+    Run text = {0};
+    Run fill = {0};
+    Chain chains[2] = {{0}};
+    RunEnd ended[33];
+    /* room for the bytes either side of a chunk, which may be cut short
+     * by the end */
+    uint8_t window[1 + 64 + 16];
+    for (size_t address = start; address < end; address += 64) {
+        const size_t valid = end - address < 64 ? end - address : 64;
+        const uint8_t* bytes = ctx->data + (address - ctx->base);
+        const uint8_t* w = bytes;
+        if (address == start || address + 64 >= end) {
+            /* the first byte never equals the one before */
+            window[0] = address == start ? ~bytes[0] : bytes[-1];
+            memcpy(window + 1, bytes, valid);
+            memset(window + 1 + valid, 0, sizeof(window) - 1 - valid);
+            if (valid == 64 && address + 64 < end)
+                window[65] = bytes[64];
+            w = window + 1;
+        }
+        uint64_t masks[MASK_COUNT];
+        RegionMasks(w, pages, masks);
+        if (valid < 64) {
+            const uint64_t keep = (1ull << valid) - 1;
+            for (int k = 0; k < MASK_COUNT; ++k)
+                masks[k] &= keep;
+        }
+        size_t n = RunStep(&text, masks[MASK_PRINT], masks[MASK_WORD], masks[MASK_SPACE], address, STRING_MIN,
+                           ended);
+        for (size_t k = 0; k < n; ++k)
+            EndString(&c, &ended[k]);
+        n = RunStep(&fill, masks[MASK_SAME], 0, 0, address, FILL_MIN - 1, ended);
+        for (size_t k = 0; k < n; ++k)
+            EndFill(&c, &ended[k], ctx);
+
+        for (uint64_t links = masks[MASK_LINK]; links; links &= links - 1) {
+            const size_t at = address + __builtin_ctzll(links);
+            if (at < start + 2 || at + 1 >= end)
+                continue;
+            const uint8_t* p = ctx->data + (at - ctx->base);
+            if (!InImage(ctx, p[0] | p[1] << 8) || !InImage(ctx, p[-2] | p[-1] << 8))
+                continue;
+            Chain* chain = &chains[at & 1];
+            if (chain->count && chain->start + 2 * chain->count == at) {
+                chain->count++;
+                continue;
+            }
+            EndChain(&c, chain);
+            *chain = (Chain){.start = at - 2, .count = 2};
+        }
+    }
+    if (text.open)
+        EndString(&c, &(RunEnd){text.start, end, text.words, text.spaces});
+    if (fill.open)
+        EndFill(&c, &(RunEnd){fill.start, end, 0, 0}, ctx);
+    EndChain(&c, &chains[0]);
+    EndChain(&c, &chains[1]);
+    return SettleRegions(out, c.n);
+}
+
+/* a number in the syntax's notation, at least digits hex digits long */
+static char* PutNumber(char* p, int syntax, size_t v, int digits) {
+    for (const char* c = data_numbers[syntax].prefix; *c; ++c)
+        *p++ = *c;
+    while (digits < (int)sizeof(size_t) * 2 && v >> (digits * 4))
+        ++digits;
+    for (int k = digits - 1; k >= 0; --k)
+        *p++ = disasm_hex_pairs[(v >> (k * 4) & 0xf) * 2 + 1];
+    for (const char* c = data_numbers[syntax].suffix; *c; ++c)
+        *p++ = *c;
+    return p;
+}
+
+size_t FormatRegion(char* out, int syntax, const DataRegion* region, size_t address, const uint8_t* bytes, size_t n,
+                    size_t* used) {
+    char* p = DisasmPutAddress(out, address);
+    size_t i = 0;
+    switch (region->kind) {
+        case REGION_FILL:
+            /* DS only reserves the bytes, so a listing gives what they hold
+             * in a comment; source for the assembler gives it as the fill */
+            memcpy(p, "DS\t", 3);
+            p = PutNumber(p + 3, syntax, n, 4);
+            if (syntax == SYNTAX_ASM) {
+                *p++ = ',';
+            } else {
+                memcpy(p, "\t; fill ", 8);
+                p += 8;
+            }
+            p = PutNumber(p, syntax, region->fill, 2);
+            i = n;
+            break;
+        case REGION_TABLE:
+            memcpy(p, "DW\t", 3);
+            p += 3;
+            for (; i + 1 < n && i < 8; i += 2) {
+                if (i)
+                    *p++ = ',';
+                p = PutNumber(p, syntax, bytes[i] | bytes[i + 1] << 8, 4);
+            }
+            break;
+        default: {
+            memcpy(p, "DB\t", 3);
+            p += 3;
+            char* const body = p;
+            int quoted = 0;
+            for (; i < n && p - body < 40; ++i) {
+                const uint8_t c = bytes[i];
+                if (c >= 0x20 && c <= 0x7e) {
+                    if (!quoted) {
+                        if (p > body)
+                            *p++ = ',';
+                        *p++ = '\'';
+                        quoted = 1;
+                    }
+                    if (c == '\'')
+                        *p++ = '\'';
+                    *p++ = c;
+                } else {
+                    if (quoted) {
+                        *p++ = '\'';
+                        quoted = 0;
+                    }
+                    if (p > body)
+                        *p++ = ',';
+                    p = PutNumber(p, syntax, c, 2);
+                }
+            }
+            if (quoted)
+                *p++ = '\'';
+            break;
+        }
+    }
+    *p++ = '\n';
+    *used = i;
+    return p - out;
+}
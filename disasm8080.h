@@ -0,0 +1,202 @@
+#ifndef DISASM8080_H
+#define DISASM8080_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* branch/call/return classification carried by every table entry */
+#define OP_JUMP     0x01 /* JMP, Jcc and PCHL */
+#define OP_CALL     0x02 /* CALL and Ccc */
+#define OP_RET      0x04 /* RET and Rcc */
+#define OP_COND     0x08 /* conditional form of a jump, call or return */
+#define OP_RST      0x10
+#define OP_HALT     0x20
+#define OP_UNDOC    0x40 /* not a documented 8080 opcode */
+#define OP_INDIRECT 0x80 /* target is not encoded in the instruction */
+
+typedef struct {
+    /* printf template; every %02x takes the next operand byte */
+    const char* instruction;
+    /* the template up to its operands, which always come last */
+    const char* text;
+    uint8_t size;
+    uint8_t text_len;
+    uint16_t flags;
+} Op;
+
+/* the decode table, indexed by opcode */
+extern const Op disasm_ops[256];
+
+Op Disassemble(uint8_t opcode);
+
+/* one byte per opcode: the length an instruction starting there has and
+ * a coarse class, for passes that only need to find boundaries */
+#define ATTR_SIZE  0x03 /* instruction length, 1 to 3 */
+#define ATTR_JUMP  0x04 /* JMP, Jcc and PCHL */
+#define ATTR_CALL  0x08 /* CALL, Ccc and RST */
+#define ATTR_RET   0x10 /* RET and Rcc */
+#define ATTR_STOP  0x20 /* execution never falls through: JMP, RET, PCHL, HLT */
+#define ATTR_UNDOC 0x40
+#define ATTR_ADDR  0x80 /* carries a 16-bit address operand */
+
+extern const uint8_t disasm_attrs[256];
+
+/* attrs[i] = disasm_attrs[data[i]] for the whole buffer */
+void ClassifyBytes(const uint8_t* data, size_t n, uint8_t* attrs);
+
+/* one decoded instruction */
+typedef struct {
+    uint32_t address;
+    uint8_t opcode;
+    uint8_t size;
+    /* operand byte or little-endian operand word, 0 when there is none */
+    uint16_t operand;
+    uint16_t flags;
+    uint16_t reserved;
+} Insn;
+
+/* record flag: the opcode byte is data nobody reaches, not an instruction */
+#define INSN_DATA 0x8000
+
+static inline void DecodeInsn(Insn* insn, size_t address, const uint8_t* bytes) {
+    const Op* op = &disasm_ops[bytes[0]];
+    insn->address = address;
+    insn->opcode = bytes[0];
+    insn->size = op->size;
+    insn->operand = op->size == 1 ? 0 : op->size == 2 ? bytes[1] : bytes[1] | bytes[2] << 8;
+    insn->flags = op->flags;
+    insn->reserved = 0;
+}
+
+/* everything the decoder needs to know about one image. The bytes stay
+ * owned by the caller and are never copied; nothing here is global, so
+ * any number of contexts can be used at once from different threads */
+typedef struct {
+    /* the image, loaded at cpu address base */
+    const uint8_t* data;
+    size_t size;
+    size_t base;
+    /* SYNTAX_INTEL unless set */
+    int syntax;
+    /* receives the rendered listing in large pieces; a non-zero return
+     * stops DisasmRange() and is passed back to its caller */
+    int (*write)(void* user, const char* text, size_t len);
+    void* user;
+} DisasmContext;
+
+/* decode instructions starting at cpu address start, while they start
+ * before end (and inside the image) and out has room for them. Operands
+ * that run off the end of the image read as zero. Returns how many were
+ * written to out and stores the address after the last one in *next
+ * when it is not NULL. Never allocates */
+size_t DecodeRange(const DisasmContext* ctx, size_t start, size_t end, Insn* out, size_t max, size_t* next);
+
+/* longest line the formatters ever produce, newline included */
+#define DISASM_LINE_MAX 64
+
+extern const char disasm_hex_pairs[513];
+
+static inline char* DisasmPutHex(char* p, uint8_t byte) {
+    p[0] = disasm_hex_pairs[byte * 2];
+    p[1] = disasm_hex_pairs[byte * 2 + 1];
+    return p + 2;
+}
+
+/* same text as printf("%04lx: ", address) */
+static inline char* DisasmPutAddress(char* p, size_t address) {
+    if (address <= 0xffff) {
+        p = DisasmPutHex(p, address >> 8);
+        p = DisasmPutHex(p, address & 0xff);
+    } else {
+        char digits[sizeof(size_t) * 2];
+        size_t n = 0;
+        while (address) {
+            digits[n++] = disasm_hex_pairs[(address & 0xf) * 2 + 1];
+            address >>= 4;
+        }
+        while (n)
+            *p++ = digits[--n];
+    }
+    *p++ = ':';
+    *p++ = ' ';
+    return p;
+}
+
+/* listing flavours; each one has its own table and its own formatter,
+ * so choosing one costs nothing per instruction */
+enum {
+    SYNTAX_INTEL, /* 8080 mnemonics, operand bytes in the printf template order */
+    SYNTAX_Z80,   /* Zilog mnemonics for the same opcodes, $ hex numbers */
+    SYNTAX_ASM,   /* 8080 mnemonics an assembler takes back: 0..h numbers,
+                   * undocumented opcodes as DB */
+    SYNTAX_COUNT,
+};
+
+extern const char* const disasm_syntax_names[SYNTAX_COUNT];
+
+/* what an opcode's operand is rendered from */
+#define SYNTAX_NONE   0
+#define SYNTAX_BYTE   1
+#define SYNTAX_WORD   2
+#define SYNTAX_OPCODE 3 /* the opcode byte itself, for DB */
+
+/* one opcode in one syntax: fixed text, the operand, more fixed text.
+ * head is readable for 16 bytes and tail for 8 whatever their length, so
+ * both are copied with a single fixed-size move */
+typedef struct {
+    const char* head;
+    const char* tail;
+    uint8_t head_len;
+    uint8_t tail_len;
+    uint8_t operand;
+    /* characters at the end of head and the start of tail that only
+     * mark the number, such as "0" and "h"; a label replaces them too */
+    uint8_t prefix_len;
+    uint8_t suffix_len;
+} SyntaxOp;
+
+extern const SyntaxOp* const disasm_syntax[SYNTAX_COUNT];
+
+/* render one listing line into out, which needs DISASM_LINE_MAX bytes,
+ * and return its length. FormatInsn() is the Intel syntax, with operand
+ * bytes in the same order as the printf templates print them; the other
+ * syntaxes print words high byte first */
+size_t FormatInsn(char* out, const Insn* insn);
+size_t FormatInsnZ80(char* out, const Insn* insn);
+size_t FormatInsnAsm(char* out, const Insn* insn);
+
+typedef size_t (*DisasmFormatter)(char* out, const Insn* insn);
+extern const DisasmFormatter disasm_formatters[SYNTAX_COUNT];
+
+/* render up to 8 bytes that are not code as one DB line */
+size_t FormatData(char* out, size_t address, const uint8_t* bytes, size_t n);
+size_t FormatDataSyntax(char* out, int syntax, size_t address, const uint8_t* bytes, size_t n);
+
+/* decode and render [start, end) through ctx->write in ctx->syntax */
+int DisasmRange(const DisasmContext* ctx, size_t start, size_t end);
+
+/* stretches of an image that read better as data than as code */
+#define REGION_STRING 1 /* printable text, CR, LF and tab: DB 'text' */
+#define REGION_TABLE  2 /* little-endian words that point into the image: DW */
+#define REGION_FILL   3 /* one byte over and over: a single DS, the byte in a comment or, for asm, DS n,fill */
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint8_t kind;
+    /* the repeated byte of a fill */
+    uint8_t fill;
+} DataRegion;
+
+/* one streaming pass over [start, end) of ctx, storing the regions it
+ * finds to out in address order, without overlaps. Returns how many;
+ * any beyond max are dropped */
+size_t FindDataRegions(const DisasmContext* ctx, size_t start, size_t end, DataRegion* out, size_t max);
+
+/* render the next line of a region into out, which needs DISASM_LINE_MAX
+ * bytes: bytes is what is left of the region from address on, n long.
+ * Returns the length of the line and stores how many bytes it took */
+size_t FormatRegion(char* out, int syntax, const DataRegion* region, size_t address, const uint8_t* bytes, size_t n,
+                    size_t* used);
+
+#endif
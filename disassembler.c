@@ -1,898 +1,4895 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 #include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <dirent.h>
+
+#include "disasm8080.h"
+
+#define EMIT_BUF_SIZE 0x10000
+
+/* counters for --stats. Every thread fills its own and they are merged
+ * once at the end, so nothing is shared while decoding */
+typedef struct {
+    uint64_t opcodes[256];
+    uint64_t files;
+    uint64_t bytes_read;
+    uint64_t bytes_decoded;
+    uint64_t instructions;
+    double read_seconds;
+    double decode_seconds;
+    double format_seconds;
+} Stats;
+
+struct Arena;
 
 typedef struct {
-    const char* instruction;
+    FILE* file;
+    /* counters of the thread that owns the emitter, NULL unless --stats;
+     * set by the owner and left alone by EmitterInit() */
+    Stats* stats;
+    /* per-file memory of the thread that owns the emitter, likewise */
+    struct Arena* arena;
+    /* the input being listed, for messages, likewise */
+    const char* name;
+    /* listing syntax and its formatter */
+    int syntax;
+    DisasmFormatter format;
+    size_t len;
+    /* bytes already handed to file */
+    size_t flushed;
+    char buf[EMIT_BUF_SIZE];
+} Emitter;
+
+static void EmitterInit(Emitter* e, FILE* file, int syntax) {
+    e->file = file;
+    e->syntax = syntax;
+    e->format = disasm_formatters[syntax];
+    e->len = 0;
+    e->flushed = 0;
+}
+
+static int EmitFlush(Emitter* e) {
+    if (e->len && fwrite(e->buf, 1, e->len, e->file) != e->len) {
+        return EOF;
+    }
+    e->flushed += e->len;
+    e->len = 0;
+    return 0;
+}
+
+static inline int EmitInsn(Emitter* e, const Insn* insn) {
+    if (e->len > EMIT_BUF_SIZE - DISASM_LINE_MAX && EmitFlush(e) == EOF) {
+        return EOF;
+    }
+    e->len += e->format(e->buf + e->len, insn);
+    return 0;
+}
+
+/* render bytes that are not code as a DB directive, at most 8 per line */
+static int EmitData(Emitter* e, size_t address, const uint8_t* bytes, size_t n) {
+    if (e->len > EMIT_BUF_SIZE - DISASM_LINE_MAX && EmitFlush(e) == EOF) {
+        return EOF;
+    }
+    e->len += FormatDataSyntax(e->buf + e->len, e->syntax, address, bytes, n);
+    return 0;
+}
+
+/* copy arbitrary text, such as a long symbol name, through the buffer */
+static int EmitText(Emitter* e, const char* text, size_t n) {
+    while (n) {
+        if (e->len == EMIT_BUF_SIZE && EmitFlush(e) == EOF) {
+            return EOF;
+        }
+        size_t chunk = EMIT_BUF_SIZE - e->len;
+        if (chunk > n)
+            chunk = n;
+        memcpy(e->buf + e->len, text, chunk);
+        e->len += chunk;
+        text += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * bump allocator for everything one run of the decoder keeps until it is
+ * done with a file: instruction arrays, bitmaps, label tables and xrefs.
+ * Nothing is freed on its own. When a block fills up another one is
+ * chained on; ArenaReset() keeps only the biggest for the next file, so a
+ * batch worker settles on one block sized for its largest input
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
     size_t size;
-} Op;
-
-Op Disassemble(uint8_t opcode) {
-    Op op;
-    op.size = 1;
-    op.instruction = "NOP";
-    switch (opcode) {
-        case 0x00:
-            op.instruction = "NOP";
-            break;
-        case 0x01:
-            op.instruction = "LXI\tB,%02x%02x";
-            op.size = 3;
-            break;
-        case 0x02:
-            op.instruction = "STAX\tB";
-            break;
-        case 0x03:
-            op.instruction = "INX\tB";
-            break;
-        case 0x04:
-            op.instruction = "INR\tB";
-            break;
-        case 0x05:
-            op.instruction = "DCR\tB";
-            break;
-        case 0x06:
-            op.instruction = "MVI\tB,%02x";
-            op.size = 2;
-            break;
-        case 0x07:
-            op.instruction = "RLC";
-            break;
-        case 0x08:
-            op.instruction = "NOP";
-            break;
-        case 0x09:
-            op.instruction = "DAD\tB";
-            break;
-        case 0x0A:
-            op.instruction = "LDAX\tB";
-            break;
-        case 0x0B:
-            op.instruction = "DCX\tB";
-            break;
-        case 0x0C:
-            op.instruction = "INR\tC";
-            break;
-        case 0x0D:
-            op.instruction = "DCR\tC";
-            break;
-        case 0x0E:
-            op.instruction = "MVI\tC,%02x";
-            op.size = 2;
-            break;
-        case 0x0F:
-            op.instruction = "RRC";
-            break;
+    size_t used;
+    _Alignas(16) unsigned char data[];
+} ArenaBlock;
 
-        case 0x10:
-            break;
-        case 0x11:
-            op.instruction = "LXI\tD,%02x%02x";
-            op.size = 3;
-            break;
-        case 0x12:
-            op.instruction = "STAX\tD";
-            break;
-        case 0x13:
-            op.instruction = "INX\tD";
-            break;
-        case 0x14:
-            op.instruction = "INR\tD";
-            break;
-        case 0x15:
-            op.instruction = "DCR\tD";
-            break;
-        case 0x16:
-            op.instruction = "MVI\tD,%02x";
-            op.size = 2;
-            break;
-        case 0x17:
-            op.instruction = "RAL";
-            break;
-        case 0x18:
-            op.instruction = "NOP";
-            break;
-        case 0x19:
-            op.instruction = "DAD\tD";
-            break;
+#define ARENA_MIN_BLOCK 0x10000
 
-        case 0x1a:
-            op.instruction = "LDAX\tD";
-            break;
-        case 0x1b:
-            op.instruction = "DCX\tD";
-            break;
-        case 0x1c:
-            op.instruction = "INR\tE";
-            break;
-        case 0x1d:
-            op.instruction = "DCR\tE";
-            break;
-        case 0x1e:
-            op.instruction = "MVI\tE,%02x";
-            op.size = 2;
-            break;
-        case 0x1f:
-            op.instruction = "RAR";
-            break;
+typedef struct Arena {
+    ArenaBlock* head;
+    /* blocks ever taken from malloc(), which the bench reports */
+    size_t allocations;
+} Arena;
 
-        case 0x20:
-            /* This is RIM on 8085 systems ...
-             * undefined, but functionally "NOP" on 8080 */
-            op.instruction = "RIM";
-            break;
-        case 0x21:
-            op.instruction = "LXI\tH,%02x%02x";
-            op.size = 3;
-            break;
-        case 0x22:
-            op.instruction = "SHLD\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0x23:
-            op.instruction = "INX\tH";
-            break;
-        case 0x24:
-            op.instruction = "INR\tH";
-            break;
-        case 0x25:
-            op.instruction = "DCR\tH";
-            break;
-        case 0x26:
-            op.instruction = "MVI\tH,%02x";
-            op.size = 2;
-            break;
-        case 0x27:
-            op.instruction = "DAA";
-            break;
-        case 0x28:
-            /* empty instruction */
-            op.instruction = "NOP";
-            break;
-        case 0x29:
-            op.instruction = "DAD\tH";
-            break;
-        case 0x2a:
-            op.instruction = "LHLD\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0x2b:
-            op.instruction = "DCX\tH";
-            break;
-        case 0x2c:
-            op.instruction = "INR\tL";
-            break;
-        case 0x2d:
-            op.instruction = "DCR\tL";
-            break;
-        case 0x2e:
-            op.instruction = "MVI\tL,%02x";
-            op.size = 2;
-            break;
-        case 0x2f:
-            /* accumulator complement */
-            op.instruction = "CMA";
-            break;
+static ArenaBlock* ArenaGrow(Arena* a, size_t n) {
+    size_t size = a->head && a->head->size * 2 > n ? a->head->size * 2 : n;
+    if (size < ARENA_MIN_BLOCK)
+        size = ARENA_MIN_BLOCK;
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+    if (!block)
+        return NULL;
+    block->next = a->head;
+    block->size = size;
+    block->used = 0;
+    a->head = block;
+    a->allocations++;
+    return block;
+}
 
-        case 0x30:
-            /* SIM instruction on 8085;
-             * undefined in 8080 */
-            op.instruction = "SIM";
-            break;
-        case 0x31:
-            op.instruction = "LXI\tSP,%02x%02x";
-            op.size = 3;
-            break;
-        case 0x32:
-            op.instruction = "STA\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0x33:
-            op.instruction = "INX\tSP";
-            break;
-        case 0x34:
-            op.instruction = "INR\tM";
-            break;
-        case 0x35:
-            op.instruction = "DCR\tM";
-            break;
-        case 0x36:
-            op.instruction = "MVI\tM,%02x";
-            op.size = 2;
-            break;
-        case 0x37:
-            op.instruction = "STC";
-            break;
-        case 0x38:
-            /* no instruction */
-            op.instruction = "NOP";
-            break;
-        case 0x39:
-            op.instruction = "DAD\tSP";
-            break;
-        case 0x3a:
-            op.instruction = "LDA\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0x3b:
-            op.instruction = "DCX\tSP";
-            break;
-        case 0x3c:
-            op.instruction = "INR\tA";
-            break;
-        case 0x3d:
-            op.instruction = "DCR\tA";
-            break;
-        case 0x3e:
-            op.instruction = "MVI\tA,%02x";
-            op.size = 2;
-            break;
-        case 0x3f:
-            op.instruction = "CMC";
-            break;
+/* n bytes aligned for any of our records; NULL with errno set if there
+ * is no memory left */
+static void* ArenaAlloc(Arena* a, size_t n) {
+    n = (n + 15) & ~(size_t)15;
+    ArenaBlock* block = a->head;
+    if (!block || block->size - block->used < n) {
+        block = ArenaGrow(a, n);
+        if (!block)
+            return NULL;
+    }
+    void* p = block->data + block->used;
+    block->used += n;
+    return p;
+}
 
-        case 0x40:
-            op.instruction = "MOV\tB,B";
-            break;
-        case 0x41:
-            op.instruction = "MOV\tB,C";
-            break;
-        case 0x42:
-            op.instruction = "MOV\tB,D";
-            break;
-        case 0x43:
-            op.instruction = "MOV\tB,E";
-            break;
-        case 0x44:
-            op.instruction = "MOV\tB,H";
-            break;
-        case 0x45:
-            op.instruction = "MOV\tB,L";
-            break;
-        case 0x46:
-            op.instruction = "MOV\tB,M";
-            break;
-        case 0x47:
-            op.instruction = "MOV\tB,A";
-            break;
-        case 0x48:
-            op.instruction = "MOV\tC,B";
-            break;
-        case 0x49:
-            op.instruction = "MOV\tC,C";
-            break;
-        case 0x4a:
-            op.instruction = "MOV\tC,D";
-            break;
-        case 0x4b:
-            op.instruction = "MOV\tC,E";
-            break;
-        case 0x4c:
-            op.instruction = "MOV\tC,H";
-            break;
-        case 0x4d:
-            op.instruction = "MOV\tC,L";
-            break;
-        case 0x4e:
-            op.instruction = "MOV\tC,M";
-            break;
-        case 0x4f:
-            op.instruction = "MOV\tC,A";
-            break;
+static void* ArenaCalloc(Arena* a, size_t n) {
+    void* p = ArenaAlloc(a, n);
+    if (p)
+        memset(p, 0, n);
+    return p;
+}
 
-        case 0x50:
-            op.instruction = "MOV\tD,B";
-            break;
-        case 0x51:
-            op.instruction = "MOV\tD,C";
-            break;
-        case 0x52:
-            op.instruction = "MOV\tD,D";
-            break;
-        case 0x53:
-            op.instruction = "MOV\tD,E";
-            break;
-        case 0x54:
-            op.instruction = "MOV\tD,H";
-            break;
-        case 0x55:
-            op.instruction = "MOV\tD,L";
-            break;
-        case 0x56:
-            op.instruction = "MOV\tD,M";
-            break;
-        case 0x57:
-            op.instruction = "MOV\tD,A";
-            break;
-        case 0x58:
-            op.instruction = "MOV\tE,B";
-            break;
-        case 0x59:
-            op.instruction = "MOV\tE,C";
-            break;
-        case 0x5a:
-            op.instruction = "MOV\tE,D";
-            break;
-        case 0x5b:
-            op.instruction = "MOV\tE,E";
-            break;
-        case 0x5c:
-            op.instruction = "MOV\tE,H";
-            break;
-        case 0x5d:
-            op.instruction = "MOV\tE,L";
-            break;
-        case 0x5e:
-            op.instruction = "MOV\tE,M";
-            break;
-        case 0x5f:
-            op.instruction = "MOV\tE,A";
-            break;
+/* make sure the next n bytes come from a single block, so a run sized
+ * up front costs one allocation at most */
+static int ArenaReserve(Arena* a, size_t n) {
+    n = (n + 15) & ~(size_t)15;
+    if (a->head && a->head->size - a->head->used >= n)
+        return 0;
+    return ArenaGrow(a, n) ? 0 : -1;
+}
 
-        case 0x60:
-            op.instruction = "MOV\tH,B";
-            break;
-        case 0x61:
-            op.instruction = "MOV\tH,C";
-            break;
-        case 0x62:
-            op.instruction = "MOV\tH,D";
-            break;
-        case 0x63:
-            op.instruction = "MOV\tH,E";
-            break;
-        case 0x64:
-            op.instruction = "MOV\tH,H";
-            break;
-        case 0x65:
-            op.instruction = "MOV\tH,L";
-            break;
-        case 0x66:
-            op.instruction = "MOV\tH,M";
-            break;
-        case 0x67:
-            op.instruction = "MOV\tH,A";
-            break;
-        case 0x68:
-            op.instruction = "MOV\tL,B";
-            break;
-        case 0x69:
-            op.instruction = "MOV\tL,C";
-            break;
-        case 0x6a:
-            op.instruction = "MOV\tL,D";
-            break;
-        case 0x6b:
-            op.instruction = "MOV\tL,E";
-            break;
-        case 0x6c:
-            op.instruction = "MOV\tL,H";
+/* forget everything allocated, keeping the biggest block */
+static void ArenaReset(Arena* a) {
+    ArenaBlock* keep = NULL;
+    for (ArenaBlock* block = a->head; block;) {
+        ArenaBlock* next = block->next;
+        if (!keep || block->size > keep->size) {
+            free(keep);
+            keep = block;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+    if (keep) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    a->head = keep;
+}
+
+static void ArenaFree(Arena* a) {
+    while (a->head) {
+        ArenaBlock* next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
+
+#define MEM_SIZE 0x10000
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    /* length of the mapping when data is mmap'd, 0 when data is malloc'd */
+    size_t map_size;
+} Image;
+
+/* map a regular file read-only so it can be decoded in place; pipes,
+ * terminals and stdin ("-") are read into a heap buffer instead, which
+ * stops one byte past max so the caller can still tell it is too big */
+static int LoadImage(const char* path, size_t max, Image* image) {
+    image->data = NULL;
+    image->size = 0;
+    image->map_size = 0;
+    int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        goto fail;
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            image->data = map;
+            image->size = st.st_size;
+            image->map_size = st.st_size;
+            if (fd != STDIN_FILENO)
+                close(fd);
+            return 0;
+        }
+    }
+    /* fall back to reading whatever the descriptor gives us */
+    size_t cap = 0;
+    uint8_t* buf = NULL;
+    for (;;) {
+        if (image->size == cap) {
+            if (cap > max)
+                break;
+            cap = cap ? cap * 2 : 0x1000;
+            uint8_t* grown = realloc(buf, cap);
+            if (!grown) {
+                free(buf);
+                goto fail;
+            }
+            buf = grown;
+        }
+        ssize_t n = read(fd, buf + image->size, cap - image->size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            goto fail;
+        }
+        if (n == 0)
             break;
-        case 0x6d:
-            op.instruction = "MOV\tL,L";
+        image->size += n;
+    }
+    image->data = buf;
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return 0;
+fail:
+    if (fd != STDIN_FILENO) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+    }
+    image->size = 0;
+    return -1;
+}
+
+static void FreeImage(Image* image) {
+    if (image->map_size)
+        munmap((void*)image->data, image->map_size);
+    else
+        free((void*)image->data);
+    image->data = NULL;
+    image->size = 0;
+}
+
+/* decode [start, end) of an image loaded at cpu address base; operands
+ * that run off the end of the image read as zero */
+static inline DisasmContext ImageContext(const Image* image, size_t base) {
+    return (DisasmContext){.data = image->data, .size = image->size, .base = base};
+}
+
+/* DisasmRange() output callback: straight to the emitter's file */
+static int EmitterWrite(void* user, const char* text, size_t len) {
+    Emitter* e = user;
+    if (fwrite(text, 1, len, e->file) != len) {
+        return EOF;
+    }
+    e->flushed += len;
+    return 0;
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void StatsCount(Stats* s, const Insn* insns, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (insns[i].flags & INSN_DATA)
+            continue;
+        s->opcodes[insns[i].opcode]++;
+        s->bytes_decoded += insns[i].size;
+        s->instructions++;
+    }
+}
+
+static void StatsMerge(Stats* into, const Stats* from) {
+    for (size_t i = 0; i < 256; ++i)
+        into->opcodes[i] += from->opcodes[i];
+    into->files += from->files;
+    into->bytes_read += from->bytes_read;
+    into->bytes_decoded += from->bytes_decoded;
+    into->instructions += from->instructions;
+    into->read_seconds += from->read_seconds;
+    into->decode_seconds += from->decode_seconds;
+    into->format_seconds += from->format_seconds;
+}
+
+static int WriteStats(FILE* out, const Stats* s) {
+    uint64_t undocumented = 0;
+    for (size_t i = 0; i < 256; ++i)
+        if (disasm_ops[i].flags & OP_UNDOC)
+            undocumented += s->opcodes[i];
+    fprintf(out, "{\n  \"files\": %" PRIu64 ",\n  \"bytes_read\": %" PRIu64 ",\n"
+            "  \"bytes_decoded\": %" PRIu64 ",\n  \"instructions\": %" PRIu64 ",\n"
+            "  \"undocumented\": %" PRIu64 ",\n",
+            s->files, s->bytes_read, s->bytes_decoded, s->instructions, undocumented);
+    fprintf(out, "  \"seconds\": {\"read\": %.6f, \"decode\": %.6f, \"format\": %.6f},\n",
+            s->read_seconds, s->decode_seconds, s->format_seconds);
+    /* undocumented opcodes by name as well, they are what people look for */
+    fputs("  \"undocumented_opcodes\": {", out);
+    const char* sep = "";
+    for (size_t i = 0; i < 256; ++i) {
+        if (disasm_ops[i].flags & OP_UNDOC && s->opcodes[i]) {
+            fprintf(out, "%s\"%02zx\": %" PRIu64, sep, i, s->opcodes[i]);
+            sep = ", ";
+        }
+    }
+    fputs("},\n  \"opcodes\": [", out);
+    for (size_t i = 0; i < 256; ++i)
+        fprintf(out, "%s%s%" PRIu64, i ? "," : "", i % 16 ? " " : "\n    ", s->opcodes[i]);
+    fputs("\n  ]\n}\n", out);
+    return ferror(out) ? EOF : 0;
+}
+
+#define PHASE_BLOCK 0x400
+
+/* the linear sweep decoded and formatted a block at a time instead of
+ * fused, so --stats can time the two apart and count opcodes from each
+ * decoded block */
+static int SweepPhased(Emitter* e, const DisasmContext* ctx, size_t start, size_t end) {
+    Stats* stats = e->stats;
+    Insn insns[PHASE_BLOCK];
+    for (;;) {
+        const double t0 = Now();
+        const size_t n = DecodeRange(ctx, start, end, insns, PHASE_BLOCK, &start);
+        StatsCount(stats, insns, n);
+        const double t1 = Now();
+        for (size_t i = 0; i < n; ++i)
+            if (EmitInsn(e, &insns[i]) == EOF)
+                return EOF;
+        stats->decode_seconds += t1 - t0;
+        stats->format_seconds += Now() - t1;
+        if (n < PHASE_BLOCK)
             break;
-        case 0x6e:
-            op.instruction = "MOV\tL,M";
+    }
+    return EmitFlush(e);
+}
+
+/* decode [start, end) of an image loaded at cpu address base */
+static int SweepLinear(Emitter* e, const Image* image, size_t base, size_t start, size_t end) {
+    DisasmContext ctx = ImageContext(image, base);
+    ctx.syntax = e->syntax;
+    if (e->stats)
+        return SweepPhased(e, &ctx, start, end);
+    ctx.write = EmitterWrite;
+    ctx.user = e;
+    if (EmitFlush(e) == EOF) {
+        return EOF;
+    }
+    return DisasmRange(&ctx, start, end) ? EOF : 0;
+}
+
+/* render a data region a line at a time */
+static int EmitRegion(Emitter* e, const DataRegion* region, const uint8_t* bytes) {
+    for (size_t address = region->start; address < region->end;) {
+        if (e->len > EMIT_BUF_SIZE - DISASM_LINE_MAX && EmitFlush(e) == EOF) {
+            return EOF;
+        }
+        size_t used;
+        e->len += FormatRegion(e->buf + e->len, e->syntax, region, address, bytes + (address - region->start),
+                               region->end - address, &used);
+        address += used;
+    }
+    return 0;
+}
+
+/* --data: the linear sweep of [start, end) with the strings, tables and
+ * fills that FindDataRegions() picks out listed as data. An instruction
+ * that would run into a region is listed as DB, and the sweep picks up
+ * again where the region ends */
+static int SweepData(Emitter* e, const Image* image, size_t base, size_t start, size_t end) {
+    if (end <= start)
+        return 0;
+    Arena local = {0};
+    Arena* arena = e->arena ? e->arena : &local;
+    const DisasmContext ctx = ImageContext(image, base);
+    /* before they are settled the candidates of one kind, and the tables
+     * of one parity, do not overlap and are all 6 bytes or longer */
+    const size_t max = (end - start) / 2 + 4;
+    DataRegion* regions = ArenaAlloc(arena, max * sizeof(DataRegion));
+    if (!regions) {
+        ArenaFree(&local);
+        return EOF;
+    }
+    const size_t n = FindDataRegions(&ctx, start, end, regions, max);
+    int status = 0;
+    for (size_t i = 0, address = start; i <= n && status == 0; ++i) {
+        const size_t stop = i < n ? regions[i].start : end;
+        size_t fit = address;
+        while (fit < stop && fit + disasm_ops[ctx.data[fit - base]].size <= stop)
+            fit += disasm_ops[ctx.data[fit - base]].size;
+        if (fit > address)
+            status = SweepLinear(e, image, base, address, fit);
+        if (status == 0 && fit < stop)
+            status = EmitData(e, fit, ctx.data + (fit - base), stop - fit);
+        if (status == 0 && i < n) {
+            status = EmitRegion(e, &regions[i], ctx.data + (regions[i].start - base));
+            address = regions[i].end;
+        }
+    }
+    ArenaFree(&local);
+    return status ? EOF : EmitFlush(e);
+}
+
+#define MAX_ENTRIES 64
+#define MAX_RANGES 64
+/* a range without a bank applies to every bank that maps it */
+#define ANY_BANK SIZE_MAX
+
+enum {
+    FORMAT_TEXT,
+    FORMAT_BIN,
+};
+
+/* what --emit writes: the listing, JSON lines or --format=bin records */
+enum {
+    EMIT_TEXT,
+    EMIT_JSON,
+    EMIT_BIN,
+    EMIT_KINDS,
+};
+
+static const char* const emit_kinds[EMIT_KINDS] = {"text", "json", "bin"};
+
+#define MAX_EMITS 8
+
+typedef struct {
+    const char* program_name;
+    size_t offset;
+    size_t jump;
+    /* split a linear sweep across this many threads when above 1 */
+    size_t threads;
+    /* follow control flow from the entry points instead of sweeping */
+    int recursive;
+    int format;
+    /* name branch and data targets; user symbols come from --symbols */
+    int labels;
+    const struct SymbolTable* symbols;
+    /* extra entry points for the traversal, relative to offset */
+    size_t entries[MAX_ENTRIES];
+    size_t n_entries;
+    /* file holding the last linear text sweep for incremental reruns */
+    const char* cache;
+    /* SYNTAX_INTEL, SYNTAX_Z80 or SYNTAX_ASM */
+    int syntax;
+    /* where to save the cross-reference index of the listing */
+    const char* xref;
+    /* [start, end) cpu addresses to list instead of the whole image */
+    size_t ranges[MAX_RANGES][2];
+    /* with --bank, the one bank each range is taken from, or ANY_BANK */
+    size_t range_banks[MAX_RANGES];
+    size_t n_ranges;
+    /* at most this many instructions from each range, 0 for all */
+    size_t count;
+    /* --emit: render the one decode to each of these at the same time */
+    struct {
+        int kind;
+        const char* path;
+    } emits[MAX_EMITS];
+    size_t n_emits;
+    /* addresses an emulator trace shows were executed, or NULL */
+    const uint64_t* executed;
+    /* where to save the control-flow graph, as Graphviz and as arrays */
+    const char* cfg_dot;
+    const char* cfg_bin;
+    /* list the strings, tables and fills the heuristics find as data */
+    int data;
+    /* --asm: source an assembler rebuilds the image from; --verify:
+     * assemble that listing again and compare it with the image */
+    int reassemble;
+    int verify;
+} Options;
+
+/* code found by following control flow or from a trace, rather than by
+ * sweeping */
+static inline int Marked(const Options* options) {
+    return options->recursive || options->executed;
+}
+
+/* one bit per cpu address */
+#define BITMAP_WORDS (MEM_SIZE / 64)
+
+static inline int BitTest(const uint64_t* map, size_t address) {
+    return map[address >> 6] >> (address & 63) & 1;
+}
+
+static inline void BitSet(uint64_t* map, size_t address) {
+    map[address >> 6] |= (uint64_t)1 << (address & 63);
+}
+
+typedef struct {
+    /* first byte of every reached instruction */
+    uint64_t starts[BITMAP_WORDS];
+    /* addresses already pushed, so each one is queued at most once */
+    uint64_t queued[BITMAP_WORDS];
+    /* worklist of addresses still to follow; it can never hold more
+     * than one entry per address */
+    uint16_t work[MEM_SIZE];
+    size_t depth;
+} Traversal;
+
+static inline void TraversalPush(Traversal* t, size_t address, size_t base, size_t end) {
+    if (address >= base && address < end && !BitTest(t->queued, address)) {
+        BitSet(t->queued, address);
+        t->work[t->depth++] = address;
+    }
+}
+
+/* follow every path from the queued entry points, marking instruction
+ * starts; a path ends at RET, JMP, PCHL, HLT, code it has already seen
+ * or an instruction that would run off the end of the image */
+static void Traverse(Traversal* t, const Image* image, size_t base) {
+    const size_t end = base + image->size;
+    while (t->depth) {
+        size_t address = t->work[--t->depth];
+        while (address < end && !BitTest(t->starts, address)) {
+            const uint8_t* bytes = image->data + (address - base);
+            const Op* op = &disasm_ops[bytes[0]];
+            if (address + op->size > end)
+                break;
+            BitSet(t->starts, address);
+            if (op->size == 3 && op->flags & (OP_JUMP | OP_CALL))
+                TraversalPush(t, bytes[1] | bytes[2] << 8, base, end);
+            else if (op->flags & OP_RST)
+                TraversalPush(t, bytes[0] & 0x38, base, end);
+            if (op->flags & OP_HALT || (op->flags & (OP_JUMP | OP_RET) && !(op->flags & OP_COND)))
+                break;
+            address += op->size;
+        }
+    }
+}
+
+/* decode the whole image in address order: instructions where starts has
+ * a bit and everything else as one INSN_DATA record per byte. A start too
+ * close to the end for its operands, which a trace can mark, is data too */
+static size_t DecodeStarts(const Image* image, size_t base, const uint64_t* starts, Insn* out) {
+    const size_t end = base + image->size;
+    size_t n = 0;
+    for (size_t address = base; address < end; address += out[n++].size) {
+        const uint8_t* bytes = image->data + (address - base);
+        if (BitTest(starts, address) && address + disasm_ops[bytes[0]].size <= end) {
+            DecodeInsn(&out[n], address, bytes);
+        } else {
+            out[n] = (Insn){.address = address, .opcode = bytes[0], .size = 1, .flags = INSN_DATA};
+        }
+    }
+    return n;
+}
+
+/* the records of a traversal from the entry points */
+static size_t DecodeRecursive(const Image* image, const Options* options, Insn* out, Arena* arena) {
+    Traversal* t = ArenaCalloc(arena, sizeof(Traversal));
+    if (!t) {
+        return 0;
+    }
+    const size_t base = options->offset;
+    const size_t end = base + image->size;
+    TraversalPush(t, base + options->jump, base, end);
+    for (size_t i = 0; i < options->n_entries; ++i)
+        TraversalPush(t, base + options->entries[i], base, end);
+    for (size_t vector = 0; vector <= 0x38; vector += 8)
+        TraversalPush(t, vector, base, end);
+    Traverse(t, image, base);
+    return DecodeStarts(image, base, t->starts, out);
+}
+
+/* the whole image as code where marked executed, as data elsewhere */
+static size_t DecodeMarked(const Image* image, const Options* options, Insn* out, Arena* arena) {
+    if (options->executed)
+        return DecodeStarts(image, options->offset, options->executed, out);
+    return DecodeRecursive(image, options, out, arena);
+}
+
+/*
+ * --pc-trace: the addresses an emulator executed, from a trace of program
+ * counters. A bin trace is little-endian 16-bit words, a text trace has
+ * one hex address at the start of each line and anything after it is
+ * ignored. A regular file is split between threads that each pread() their
+ * share into a bitmap of their own, or'ed together at the end, so no more
+ * than one read buffer per thread is ever in memory
+ */
+#define TRACE_BLOCK 0x100000
+
+enum {
+    TRACE_BIN,
+    TRACE_TEXT,
+};
+
+typedef struct {
+    uint64_t* bits;
+    int format;
+    /* the line being read: its number so far, how many digits that took
+     * and whether the rest of it is being skipped */
+    uint32_t value;
+    int digits;
+    int skipping;
+    /* the first byte of a bin word split between two reads */
+    int odd;
+    uint8_t low;
+} TraceParser;
+
+static inline int HexDigit(uint8_t c) {
+    if ((unsigned)(c - '0') < 10)
+        return c - '0';
+    c |= 0x20;
+    if ((unsigned)(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+static void TraceEndLine(TraceParser* t) {
+    if (t->digits)
+        BitSet(t->bits, t->value);
+    t->value = 0;
+    t->digits = 0;
+    t->skipping = 0;
+}
+
+static void TraceFeed(TraceParser* t, const uint8_t* p, size_t n) {
+    const uint8_t* end = p + n;
+    if (t->format == TRACE_BIN) {
+        if (t->odd && p < end) {
+            BitSet(t->bits, t->low | *p++ << 8);
+            t->odd = 0;
+        }
+        for (; end - p >= 2; p += 2)
+            BitSet(t->bits, p[0] | p[1] << 8);
+        if (p < end) {
+            t->odd = 1;
+            t->low = *p;
+        }
+        return;
+    }
+    while (p < end) {
+        if (t->skipping) {
+            /* memchr() is the vectorised part of reading text */
+            const uint8_t* nl = memchr(p, '\n', end - p);
+            if (!nl)
+                return;
+            p = nl;
+        }
+        const uint8_t c = *p++;
+        const int digit = HexDigit(c);
+        if (c == '\n') {
+            TraceEndLine(t);
+        } else if (digit >= 0) {
+            t->value = t->value << 4 | digit;
+            t->digits++;
+            /* too big for the cpu: not an address */
+            if (t->value > 0xffff) {
+                t->digits = 0;
+                t->skipping = 1;
+            }
+        } else if ((c | 0x20) == 'x' && t->digits == 1 && t->value == 0) {
+            t->digits = 0;
+        } else if (t->digits || (c != ' ' && c != '\t' && c != '$')) {
+            t->skipping = 1;
+        }
+    }
+}
+
+typedef struct {
+    int fd;
+    int format;
+    /* bin: the bytes to read; text: the lines that start in here */
+    off_t begin;
+    off_t end;
+    uint64_t bits[BITMAP_WORDS];
+    int error;
+} TraceChunk;
+
+static void* TraceWorker(void* arg) {
+    TraceChunk* c = arg;
+    uint8_t* buf = malloc(TRACE_BLOCK);
+    if (!buf) {
+        c->error = ENOMEM;
+        return NULL;
+    }
+    TraceParser t = {.bits = c->bits, .format = c->format};
+    /* a text chunk starts after the newline that ends the line before it */
+    int started = c->format == TRACE_BIN || c->begin == 0;
+    off_t at = started ? c->begin : c->begin - 1;
+    for (;;) {
+        size_t want = TRACE_BLOCK;
+        if (c->format == TRACE_BIN && (off_t)want > c->end - at)
+            want = c->end - at;
+        if (!want)
+            break;
+        const ssize_t n = pread(c->fd, buf, want, at);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            c->error = errno;
             break;
-        case 0x6f:
-            op.instruction = "MOV\tL,A";
+        }
+        if (n == 0) {
+            if (started)
+                TraceEndLine(&t);
             break;
+        }
+        const uint8_t* p = buf;
+        const uint8_t* block_end = buf + n;
+        if (!started) {
+            const uint8_t* nl = memchr(p, '\n', n);
+            if (!nl) {
+                at += n;
+                if (at > c->end)
+                    break;
+                continue;
+            }
+            started = 1;
+            p = nl + 1;
+            if (at + (p - buf) >= c->end)
+                break;
+        }
+        /* the last line may run past end; it is read up to its newline */
+        if (c->format == TRACE_TEXT && at + n >= c->end) {
+            const off_t from = at + (p - buf) > c->end - 1 ? at + (p - buf) : c->end - 1;
+            const uint8_t* nl = memchr(buf + (from - at), '\n', block_end - (buf + (from - at)));
+            if (nl) {
+                TraceFeed(&t, p, nl + 1 - p);
+                break;
+            }
+        }
+        TraceFeed(&t, p, block_end - p);
+        at += n;
+    }
+    free(buf);
+    return NULL;
+}
 
-        case 0x70:
-            op.instruction = "MOV\tM,B";
-            break;
-        case 0x71:
-            op.instruction = "MOV\tM,C";
+/* a pipe or a terminal, read as it comes */
+static int ReadTraceStream(int fd, int format, uint64_t* bits) {
+    uint8_t* buf = malloc(TRACE_BLOCK);
+    if (!buf) {
+        return -1;
+    }
+    TraceParser t = {.bits = bits, .format = format};
+    int status = 0;
+    for (;;) {
+        const ssize_t n = read(fd, buf, TRACE_BLOCK);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            status = -1;
             break;
-        case 0x72:
-            op.instruction = "MOV\tM,D";
+        }
+        if (n == 0) {
+            TraceEndLine(&t);
             break;
-        case 0x73:
-            op.instruction = "MOV\tM,E";
-            break;
-        case 0x74:
-            op.instruction = "MOV\tM,H";
-            break;
-        case 0x75:
-            op.instruction = "MOV\tM,L";
-            break;
-        case 0x76:
-            /* halt instruction */
-            op.instruction = "HLT";
-            break;
-        case 0x77:
-            op.instruction = "MOV\tM,A";
-            break;
-        case 0x78:
-            op.instruction = "MOV\tA,B";
-            break;
-        case 0x79:
-            op.instruction = "MOV\tA,C";
-            break;
-        case 0x7a:
-            op.instruction = "MOV\tA,D";
-            break;
-        case 0x7b:
-            op.instruction = "MOV\tA,E";
-            break;
-        case 0x7c:
-            op.instruction = "MOV\tA,H";
-            break;
-        case 0x7d:
-            op.instruction = "MOV\tA,L";
-            break;
-        case 0x7e:
-            op.instruction = "MOV\tA,M";
-            break;
-        case 0x7f:
-            op.instruction = "MOV\tA,A";
+        }
+        TraceFeed(&t, buf, n);
+    }
+    free(buf);
+    return status;
+}
+
+/* set the bit of every address in the trace at path, "-" for stdin */
+static int LoadTrace(const char* path, int format, size_t threads, uint64_t* bits) {
+    const int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    struct stat st;
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        if (fd != STDIN_FILENO) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+        }
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        const int status = ReadTraceStream(fd, format, bits);
+        if (fd != STDIN_FILENO)
+            close(fd);
+        return status;
+    }
+    /* every thread gets a few blocks at least */
+    size_t n = threads;
+    if (n > (size_t)st.st_size / (4 * TRACE_BLOCK))
+        n = st.st_size / (4 * TRACE_BLOCK);
+    if (n < 1)
+        n = 1;
+    TraceChunk* chunks = calloc(n, sizeof(TraceChunk));
+    pthread_t* workers = malloc(n * sizeof(pthread_t));
+    if (!chunks || !workers) {
+        free(chunks);
+        free(workers);
+        close(fd);
+        return -1;
+    }
+    const off_t share = st.st_size / (off_t)n;
+    size_t started = 0;
+    int error = 0;
+    for (size_t i = 0; i < n; ++i) {
+        TraceChunk* c = &chunks[i];
+        c->fd = fd;
+        c->format = format;
+        c->begin = share * (off_t)i & ~(off_t)1;
+        c->end = i + 1 == n ? st.st_size : share * (off_t)(i + 1) & ~(off_t)1;
+        if (i + 1 == n && format == TRACE_BIN)
+            c->end &= ~(off_t)1;
+        /* the first chunk is read on this thread */
+        if (i && (error = pthread_create(&workers[i], NULL, TraceWorker, c)))
+            break;
+        started = i + 1;
+    }
+    if (started)
+        TraceWorker(&chunks[0]);
+    for (size_t i = 1; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    for (size_t i = 0; i < started; ++i) {
+        if (chunks[i].error && !error)
+            error = chunks[i].error;
+        for (size_t w = 0; w < BITMAP_WORDS; ++w)
+            bits[w] |= chunks[i].bits[w];
+    }
+    free(chunks);
+    free(workers);
+    close(fd);
+    errno = error;
+    return error ? -1 : 0;
+}
+
+
+/*
+ * --range and --count. Without a traversal a range starts on the first
+ * instruction that the linear sweep from the jump point lists at or after
+ * its start address, found without decoding the bytes in between
+ */
+
+/* the first boundary at or past address of a sweep begun at from */
+static size_t SweepTo(const DisasmContext* ctx, size_t from, size_t address) {
+    while (from < address)
+        from += disasm_ops[ctx->data[from - ctx->base]].size;
+    return from;
+}
+
+/* the real sweep starts an instruction on one of any three consecutive
+ * bytes, so when sweeps begun on three of them meet at one boundary it
+ * meets there too. They start close and move back twice as far each time
+ * they disagree, until decoding from the jump point is no dearer */
+static size_t AlignRange(const DisasmContext* ctx, size_t sweep_start, size_t address) {
+    if (address <= sweep_start)
+        return address;
+    for (size_t window = 16;; window *= 2) {
+        if (address - sweep_start <= window + 2)
+            return SweepTo(ctx, sweep_start, address);
+        const size_t from = address - window;
+        const size_t boundary = SweepTo(ctx, from, address);
+        if (SweepTo(ctx, from - 1, address) == boundary && SweepTo(ctx, from - 2, address) == boundary)
+            return boundary;
+    }
+}
+
+/* range i clipped to the image */
+static int ClipRange(const DisasmContext* ctx, const Options* options, size_t i, size_t* start, size_t* end) {
+    const size_t image_end = ctx->base + ctx->size;
+    *start = options->ranges[i][0] < ctx->base ? ctx->base : options->ranges[i][0];
+    *end = options->ranges[i][1] > image_end ? image_end : options->ranges[i][1];
+    return *start < *end;
+}
+
+/* range i clipped, aligned and cut short after --count instructions;
+ * 0 when nothing of it is left. The sweep it is aligned to begins at the
+ * jump point, which for a bank is where the bank is mapped */
+static int ResolveRange(const DisasmContext* ctx, const Options* options, size_t i, size_t* start, size_t* end) {
+    if (!ClipRange(ctx, options, i, start, end))
+        return 0;
+    *start = AlignRange(ctx, ctx->base + options->jump, *start);
+    if (options->count) {
+        size_t address = *start;
+        for (size_t n = 0; n < options->count && address < *end; ++n)
+            address += disasm_ops[ctx->data[address - ctx->base]].size;
+        if (address < *end)
+            *end = address;
+    }
+    return *start < *end;
+}
+
+/* at most one record per byte of every range */
+static size_t RangeRecords(const DisasmContext* ctx, const Options* options) {
+    size_t total = 0;
+    for (size_t i = 0; i < options->n_ranges; ++i) {
+        size_t start, end;
+        if (ClipRange(ctx, options, i, &start, &end))
+            total += end - start;
+    }
+    return total;
+}
+
+static size_t DecodeRanges(const DisasmContext* ctx, const Options* options, Insn* out, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < options->n_ranges; ++i) {
+        size_t start, end;
+        if (ResolveRange(ctx, options, i, &start, &end))
+            n += DecodeRange(ctx, start, end, out + n, max - n, NULL);
+    }
+    return n;
+}
+
+/* the records of a traversal that fall in the ranges, in range order */
+static size_t SelectRanges(const DisasmContext* ctx, const Options* options, const Insn* insns, size_t n,
+                           Insn* out) {
+    size_t picked = 0;
+    for (size_t i = 0; i < options->n_ranges; ++i) {
+        size_t start, end;
+        if (!ClipRange(ctx, options, i, &start, &end))
+            continue;
+        size_t lo = 0;
+        size_t hi = n;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (insns[mid].address < start)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        /* data bytes nothing reached come along but are not instructions */
+        for (size_t k = lo, taken = 0; k < n && insns[k].address < end && (!options->count || taken < options->count);
+             ++k) {
+            out[picked++] = insns[k];
+            taken += !(insns[k].flags & INSN_DATA);
+        }
+    }
+    return picked;
+}
+
+static int SweepRanges(Emitter* e, const Image* image, const Options* options) {
+    const DisasmContext ctx = ImageContext(image, options->offset);
+    for (size_t i = 0; i < options->n_ranges; ++i) {
+        size_t start, end;
+        if (!ResolveRange(&ctx, options, i, &start, &end))
+            continue;
+        if ((options->data ? SweepData : SweepLinear)(e, image, options->offset, start, end) == EOF)
+            return EOF;
+    }
+    return 0;
+}
+
+/* render records as the text listing; runs of data records become DB
+ * lines of at most 8 bytes */
+static int EmitRecords(Emitter* e, const Insn* insns, size_t n) {
+    for (size_t i = 0; i < n;) {
+        const Insn* insn = &insns[i];
+        if (insn->flags & INSN_DATA) {
+            uint8_t bytes[8];
+            size_t run = 0;
+            while (run < 8 && i < n && insns[i].flags & INSN_DATA && insns[i].address == insn->address + run)
+                bytes[run++] = insns[i++].opcode;
+            if (EmitData(e, insn->address, bytes, run) == EOF)
+                return EOF;
+            continue;
+        }
+        if (EmitInsn(e, insn) == EOF)
+            return EOF;
+        ++i;
+    }
+    return EmitFlush(e);
+}
+
+/* --format=bin: a 16 byte header followed by count 12 byte records, all
+ * little-endian, so the file can be mmap'd and indexed directly */
+#define RECORD_MAGIC "I80R"
+#define RECORD_VERSION 1
+#define RECORD_HEADER_SIZE 16
+#define RECORD_SIZE 12
+
+static inline uint8_t* PutLE16(uint8_t* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t* PutLE32(uint8_t* p, uint32_t v) {
+    p = PutLE16(p, v);
+    return PutLE16(p, v >> 16);
+}
+
+static inline uint16_t GetLE16(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+}
+
+static inline uint32_t GetLE32(const uint8_t* p) {
+    return GetLE16(p) | (uint32_t)GetLE16(p + 2) << 16;
+}
+
+static uint8_t* PutRecordHeader(uint8_t* p, size_t n) {
+    memcpy(p, RECORD_MAGIC, 4);
+    p = PutLE16(p + 4, RECORD_VERSION);
+    p = PutLE16(p, RECORD_SIZE);
+    p = PutLE32(p, n);
+    return PutLE32(p, 0);
+}
+
+static inline uint8_t* PutRecord(uint8_t* p, const Insn* insn) {
+    p = PutLE32(p, insn->address);
+    *p++ = insn->opcode;
+    *p++ = insn->size;
+    p = PutLE16(p, insn->operand);
+    p = PutLE16(p, insn->flags);
+    return PutLE16(p, insn->reserved);
+}
+
+static int WriteRecords(FILE* out, const Insn* insns, size_t n) {
+    uint8_t buf[RECORD_SIZE * 1024];
+    uint8_t* p = PutRecordHeader(buf, n);
+    if (fwrite(buf, 1, RECORD_HEADER_SIZE, out) != RECORD_HEADER_SIZE)
+        return EOF;
+    for (size_t i = 0; i < n;) {
+        p = buf;
+        for (; i < n && p < buf + sizeof(buf); ++i)
+            p = PutRecord(p, &insns[i]);
+        if (fwrite(buf, 1, p - buf, out) != (size_t)(p - buf))
+            return EOF;
+    }
+    return 0;
+}
+
+/* the reader side of --format=bin: turn a record file back into the
+ * text listing it was decoded from */
+static int ReadRecords(Emitter* e, const Image* image) {
+    const uint8_t* p = image->data;
+    if (image->size < RECORD_HEADER_SIZE || memcmp(p, RECORD_MAGIC, 4) || GetLE16(p + 4) != RECORD_VERSION) {
+        errno = EINVAL;
+        return EOF;
+    }
+    const size_t record_size = GetLE16(p + 6);
+    const size_t count = GetLE32(p + 8);
+    if (record_size < RECORD_SIZE || count > (image->size - RECORD_HEADER_SIZE) / record_size) {
+        errno = EINVAL;
+        return EOF;
+    }
+    Insn* insns = malloc((count ? count : 1) * sizeof(Insn));
+    if (!insns) {
+        return EOF;
+    }
+    p += RECORD_HEADER_SIZE;
+    for (size_t i = 0; i < count; ++i, p += record_size) {
+        insns[i] = (Insn){
+                .address = GetLE32(p),
+                .opcode = p[4],
+                .size = p[5],
+                .operand = GetLE16(p + 6),
+                .flags = GetLE16(p + 8),
+        };
+    }
+    int status = EmitRecords(e, insns, count);
+    free(insns);
+    return status;
+}
+
+/* open-addressing hash index from address to symbol name, sized up
+ * front so a large symbol file never rehashes while it loads */
+typedef struct SymbolTable {
+    /* key + 1, so that 0 marks an empty slot */
+    uint32_t* keys;
+    /* NULL for a generated Lxxxx label */
+    const char** names;
+    size_t mask;
+    size_t count;
+    /* where the slots come from; NULL for the heap */
+    Arena* arena;
+} SymbolTable;
+
+static inline size_t SymbolHash(uint32_t key) {
+    uint32_t h = key * 0x9e3779b1u;
+    return h ^ h >> 16;
+}
+
+static size_t SymbolSlots(size_t expected) {
+    size_t slots = 16;
+    while (slots < expected * 2)
+        slots *= 2;
+    return slots;
+}
+
+/* what a table for expected symbols takes out of an arena */
+static size_t SymbolBytes(size_t expected) {
+    const size_t slots = SymbolSlots(expected);
+    return slots * sizeof(uint32_t) + slots * sizeof(const char*) + 32;
+}
+
+static int SymbolInit(SymbolTable* t, size_t expected, Arena* arena) {
+    const size_t slots = SymbolSlots(expected);
+    if (arena) {
+        t->keys = ArenaCalloc(arena, slots * sizeof(*t->keys));
+        t->names = ArenaCalloc(arena, slots * sizeof(*t->names));
+    } else {
+        t->keys = calloc(slots, sizeof(*t->keys));
+        t->names = calloc(slots, sizeof(*t->names));
+    }
+    t->mask = slots - 1;
+    t->count = 0;
+    t->arena = arena;
+    return t->keys && t->names ? 0 : -1;
+}
+
+static void SymbolFree(SymbolTable* t) {
+    if (!t->arena) {
+        free(t->keys);
+        free(t->names);
+    }
+    t->keys = NULL;
+    t->names = NULL;
+}
+
+/* slot holding key, or the empty slot where it would go */
+static inline size_t SymbolSlot(const SymbolTable* t, uint32_t key) {
+    size_t i = SymbolHash(key) & t->mask;
+    while (t->keys[i] && t->keys[i] != key + 1)
+        i = (i + 1) & t->mask;
+    return i;
+}
+
+static inline int SymbolFind(const SymbolTable* t, uint32_t key, const char** name) {
+    if (!t || !t->keys)
+        return 0;
+    const size_t i = SymbolSlot(t, key);
+    if (!t->keys[i])
+        return 0;
+    *name = t->names[i];
+    return 1;
+}
+
+/* the first name given for an address wins; the table never fills past
+ * half, growing when it would */
+static int SymbolInsert(SymbolTable* t, uint32_t key, const char* name) {
+    if ((t->count + 1) * 2 > t->mask + 1) {
+        SymbolTable grown;
+        if (SymbolInit(&grown, t->count + 1, t->arena) < 0) {
+            SymbolFree(&grown);
+            return -1;
+        }
+        for (size_t i = 0; i <= t->mask; ++i) {
+            if (t->keys[i]) {
+                const size_t j = SymbolSlot(&grown, t->keys[i] - 1);
+                grown.keys[j] = t->keys[i];
+                grown.names[j] = t->names[i];
+            }
+        }
+        grown.count = t->count;
+        SymbolFree(t);
+        *t = grown;
+    }
+    const size_t i = SymbolSlot(t, key);
+    if (!t->keys[i]) {
+        t->keys[i] = key + 1;
+        t->names[i] = name;
+        ++t->count;
+    }
+    return 0;
+}
+
+/* a number in C notation, or hex with an h suffix */
+static int ParseOffset(const char* s, size_t* value) {
+    char* end;
+    const size_t n = strlen(s);
+    const int hex = n && (s[n - 1] == 'h' || s[n - 1] == 'H');
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, hex ? 16 : 0);
+    /* nothing may be left over but the suffix */
+    if (errno || end == s || end != s + n - hex || v > SIZE_MAX)
+        return -1;
+    *value = v;
+    return 0;
+}
+
+static int ParseAddress(const char* s, uint32_t* address) {
+    size_t v;
+    if (ParseOffset(s, &v) < 0 || v > 0xffff)
+        return -1;
+    *address = v;
+    return 0;
+}
+
+/* a byte count with an optional K, M or G suffix */
+static int ParseSize(const char* s, size_t* value) {
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 0);
+    const char* const suffixes = "KMG";
+    const char* suffix = *end ? memchr(suffixes, *end & ~0x20, 3) : NULL;
+    if (errno || end == s || s[0] == '-' || (*end && (!suffix || end[1])))
+        return -1;
+    for (int shift = suffix ? (suffix - suffixes + 1) * 10 : 0; shift; shift -= 10) {
+        if (v > SIZE_MAX >> 10)
+            return -1;
+        v <<= 10;
+    }
+    if (v > SIZE_MAX)
+        return -1;
+    *value = v;
+    return 0;
+}
+
+/* KIND=PATH for --emit */
+static int ParseEmit(const char* s, int* kind, const char** path) {
+    const char* sep = strchr(s, '=');
+    if (!sep || !sep[1])
+        return -1;
+    for (int i = 0; i < EMIT_KINDS; ++i) {
+        if (strlen(emit_kinds[i]) == (size_t)(sep - s) && !strncmp(s, emit_kinds[i], sep - s)) {
+            *kind = i;
+            *path = sep + 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* START:END or START: as cpu addresses, END exclusive, optionally
+ * preceded by BANK: to take the range from that bank alone */
+static int ParseRange(const char* s, size_t range[2], size_t* bank) {
+    char start[32];
+    *bank = ANY_BANK;
+    size_t n = strcspn(s, ":");
+    if (s[n] && strchr(s + n + 1, ':')) {
+        if (n >= sizeof(start))
+            return -1;
+        memcpy(start, s, n);
+        start[n] = '\0';
+        if (ParseOffset(start, bank) < 0 || *bank == ANY_BANK)
+            return -1;
+        s += n + 1;
+        n = strcspn(s, ":");
+    }
+    if (!s[n] || n >= sizeof(start))
+        return -1;
+    memcpy(start, s, n);
+    start[n] = '\0';
+    uint32_t address;
+    if (ParseAddress(start, &address) < 0)
+        return -1;
+    range[0] = address;
+    range[1] = SIZE_MAX;
+    if (s[n + 1] && (ParseOffset(s + n + 1, &range[1]) < 0 || range[1] > MEM_SIZE || range[1] <= range[0]))
+        return -1;
+    return 0;
+}
+
+/* load "NAME ADDRESS", "NAME EQU ADDRESS" or "NAME = ADDRESS" lines;
+ * ';' and '#' start comments. The file is kept in one buffer that the
+ * names point into, so *text must outlive the table */
+static int LoadSymbols(const char* path, SymbolTable* t, char** text) {
+    Image file;
+    if (LoadImage(path, SIZE_MAX - 1, &file) < 0) {
+        return -1;
+    }
+    char* buf = malloc(file.size + 1);
+    if (!buf) {
+        FreeImage(&file);
+        return -1;
+    }
+    memcpy(buf, file.data, file.size);
+    buf[file.size] = '\0';
+    size_t lines = 1;
+    for (size_t i = 0; i < file.size; ++i)
+        lines += buf[i] == '\n';
+    FreeImage(&file);
+    if (SymbolInit(t, lines, NULL) < 0) {
+        free(buf);
+        return -1;
+    }
+
+    size_t line_number = 0;
+    for (char* line = buf; line; ) {
+        char* next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        ++line_number;
+        line[strcspn(line, ";#")] = '\0';
+        char* fields[3];
+        size_t n = 0;
+        for (char* f = strtok(line, " \t\r:="); f && n < 3; f = strtok(NULL, " \t\r:="))
+            fields[n++] = f;
+        if (n == 3 && (!strcmp(fields[1], "EQU") || !strcmp(fields[1], "equ")))
+            fields[1] = fields[2], n = 2;
+        uint32_t address;
+        if (n == 2 && ParseAddress(fields[1], &address) == 0) {
+            if (SymbolInsert(t, address, fields[0]) < 0) {
+                free(buf);
+                return -1;
+            }
+        } else if (n) {
+            fprintf(stderr, "%s:%zu: expected a name and an address\n", path, line_number);
+        }
+        line = next;
+    }
+    *text = buf;
+    return 0;
+}
+
+static const char* LabelName(const SymbolTable* user, const SymbolTable* labels, uint32_t address, char* scratch) {
+    const char* name = NULL;
+    if (SymbolFind(user, address, &name) && name)
+        return name;
+    if (!SymbolFind(labels, address, &name))
+        return NULL;
+    scratch[0] = 'L';
+    DisasmPutHex(DisasmPutHex(scratch + 1, address >> 8), address & 0xff);
+    scratch[5] = '\0';
+    return scratch;
+}
+
+/* an instruction with its address operand printed as name, or as a number
+ * high byte first when there is no name */
+static int EmitNamed(Emitter* e, const Insn* insn, const char* name) {
+    const SyntaxOp* op = &disasm_syntax[e->syntax][insn->opcode];
+    char hex[5];
+    /* a label replaces the number, prefix and all */
+    size_t head_len = op->head_len - op->prefix_len;
+    size_t skip = op->suffix_len;
+    if (!name) {
+        DisasmPutHex(DisasmPutHex(hex, insn->operand >> 8), insn->operand & 0xff);
+        hex[4] = '\0';
+        name = hex;
+        head_len = op->head_len;
+        skip = 0;
+    }
+    if (e->len > EMIT_BUF_SIZE - DISASM_LINE_MAX && EmitFlush(e) == EOF) {
+        return EOF;
+    }
+    char* p = DisasmPutAddress(e->buf + e->len, insn->address);
+    memcpy(p, op->head, head_len);
+    e->len = p + head_len - e->buf;
+    if (EmitText(e, name, strlen(name)) == EOF || EmitText(e, op->tail + skip, op->tail_len - skip) == EOF)
+        return EOF;
+    return EmitText(e, "\n", 1);
+}
+
+/* the first pass of a labelled listing: the listed addresses go to a
+ * bitmap and every 16-bit operand that lands on one of them without a
+ * user symbol becomes a label */
+static int CollectLabels(SymbolTable* labels, uint64_t** listed, const Insn* insns, size_t n, const SymbolTable* user,
+                         Arena* arena) {
+    *listed = ArenaCalloc(arena, BITMAP_WORDS * sizeof(uint64_t));
+    if (!*listed) {
+        return EOF;
+    }
+    size_t operands = 0;
+    for (size_t i = 0; i < n; ++i) {
+        BitSet(*listed, insns[i].address & 0xffff);
+        operands += insns[i].size == 3;
+    }
+    /* sized for every operand being a label, so it never grows */
+    if (SymbolInit(labels, operands, arena) < 0) {
+        return EOF;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const uint16_t target = insns[i].operand;
+        const char* name;
+        if (insns[i].size == 3 && !(insns[i].flags & INSN_DATA) && BitTest(*listed, target)
+            && !(SymbolFind(user, target, &name) && name) && SymbolInsert(labels, target, NULL) < 0)
+            return EOF;
+    }
+    return 0;
+}
+
+/* two-pass listing: collect every 16-bit operand that lands on a listed
+ * address as a label, then print "NAME:" lines at the targets and the
+ * names in place of the operands. 16-bit operands without a name are
+ * printed high byte first, the way they are meant to be read */
+static int EmitLabeled(Emitter* e, const Insn* insns, size_t n, const SymbolTable* user, Arena* arena) {
+    SymbolTable labels;
+    uint64_t* listed;
+    if (CollectLabels(&labels, &listed, insns, n, user, arena) == EOF) {
+        return EOF;
+    }
+    int status = 0;
+    char scratch[8];
+    for (size_t i = 0; i < n && status == 0;) {
+        const Insn* insn = &insns[i];
+        const char* label = LabelName(user, &labels, insn->address, scratch);
+        if (label && (EmitText(e, label, strlen(label)) == EOF || EmitText(e, ":\n", 2) == EOF)) {
+            status = EOF;
             break;
+        }
+        if (insn->flags & INSN_DATA) {
+            uint8_t bytes[8];
+            size_t run = 0;
+            /* a run of data stops at the next label */
+            do {
+                bytes[run++] = insns[i++].opcode;
+            } while (run < 8 && i < n && insns[i].flags & INSN_DATA && insns[i].address == insn->address + run
+                     && !LabelName(user, &labels, insns[i].address, scratch));
+            status = EmitData(e, insn->address, bytes, run);
+            continue;
+        }
+        if (disasm_syntax[e->syntax][insn->opcode].operand == SYNTAX_WORD)
+            status = EmitNamed(e, insn, LabelName(user, &labels, insn->operand, scratch));
+        else
+            status = EmitInsn(e, insn);
+        ++i;
+    }
+    return status == EOF ? EOF : EmitFlush(e);
+}
+
+/*
+ * --asm: the labelled listing in the asm syntax as source an 8080
+ * assembler rebuilds the image from. Lines start with a tab instead of
+ * the address, ORG goes wherever the addresses jump, user symbols that
+ * are named but not listed get an EQU, and an instruction cut short by
+ * the end of the image is listed as the DB it really is
+ */
+
+/* take the address off the line EmitInsn() or EmitData() just put at
+ * from, leaving a tab in its place */
+static void Unaddress(Emitter* e, size_t from, size_t address) {
+    char prefix[DISASM_LINE_MAX];
+    const size_t skip = DisasmPutAddress(prefix, address) - prefix;
+    char* line = e->buf + from;
+    line[0] = '\t';
+    memmove(line + 1, line + skip, e->len - from - skip);
+    e->len -= skip - 1;
+}
+
+/* a line that fits the buffer without a flush halfway */
+static inline int EmitRoom(Emitter* e) {
+    return e->len > EMIT_BUF_SIZE - DISASM_LINE_MAX ? EmitFlush(e) : 0;
+}
+
+static int EmitAsmData(Emitter* e, size_t address, const uint8_t* bytes, size_t n) {
+    if (EmitRoom(e) == EOF) {
+        return EOF;
+    }
+    const size_t from = e->len;
+    EmitData(e, address, bytes, n);
+    Unaddress(e, from, address);
+    return 0;
+}
+
+/* an instruction with its address operand given as name */
+static int EmitAsmNamed(Emitter* e, const Insn* insn, const char* name) {
+    const SyntaxOp* op = &disasm_syntax[e->syntax][insn->opcode];
+    if (EmitText(e, "\t", 1) == EOF || EmitText(e, op->head, op->head_len - op->prefix_len) == EOF
+        || EmitText(e, name, strlen(name)) == EOF
+        || EmitText(e, op->tail + op->suffix_len, op->tail_len - op->suffix_len) == EOF)
+        return EOF;
+    return EmitText(e, "\n", 1);
+}
+
+/* a directive with a number, such as "\tORG\t00100h" */
+static int EmitDirective(Emitter* e, const char* name, const char* directive, size_t value) {
+    char number[8];
+    number[0] = '0';
+    DisasmPutHex(DisasmPutHex(number + 1, value >> 8), value & 0xff);
+    memcpy(number + 5, "h\n", 2);
+    if (EmitText(e, name, strlen(name)) == EOF || EmitText(e, "\t", 1) == EOF
+        || EmitText(e, directive, strlen(directive)) == EOF || EmitText(e, "\t", 1) == EOF)
+        return EOF;
+    return EmitText(e, number, 7);
+}
+
+static int EmitAsm(Emitter* e, const Insn* insns, size_t n, const DisasmContext* ctx, const SymbolTable* user,
+                   Arena* arena) {
+    SymbolTable labels;
+    uint64_t* listed;
+    uint64_t* equates = ArenaCalloc(arena, BITMAP_WORDS * sizeof(uint64_t));
+    if (!equates || CollectLabels(&labels, &listed, insns, n, user, arena) == EOF) {
+        return EOF;
+    }
+    const SyntaxOp* ops = disasm_syntax[e->syntax];
+    for (size_t i = 0; i < n; ++i) {
+        const char* name;
+        if (!(insns[i].flags & INSN_DATA) && ops[insns[i].opcode].operand == SYNTAX_WORD
+            && !BitTest(listed, insns[i].operand) && SymbolFind(user, insns[i].operand, &name) && name)
+            BitSet(equates, insns[i].operand);
+    }
+    char scratch[8];
+    for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+        for (uint64_t bits = equates[w]; bits; bits &= bits - 1) {
+            const size_t address = w * 64 + __builtin_ctzll(bits);
+            if (EmitDirective(e, LabelName(user, &labels, address, scratch), "EQU", address) == EOF)
+                return EOF;
+        }
+    }
+
+    const size_t image_end = ctx->base + ctx->size;
+    size_t next = SIZE_MAX;
+    for (size_t i = 0; i < n;) {
+        const Insn* insn = &insns[i];
+        if (insn->address != next && EmitDirective(e, "", "ORG", insn->address) == EOF)
+            return EOF;
+        const char* label = LabelName(user, &labels, insn->address, scratch);
+        if (label && (EmitText(e, label, strlen(label)) == EOF || EmitText(e, ":\n", 2) == EOF))
+            return EOF;
+        int status;
+        if (insn->flags & INSN_DATA) {
+            uint8_t bytes[8];
+            size_t run = 0;
+            do {
+                bytes[run++] = insns[i++].opcode;
+            } while (run < 8 && i < n && insns[i].flags & INSN_DATA && insns[i].address == insn->address + run
+                     && !LabelName(user, &labels, insns[i].address, scratch));
+            status = EmitAsmData(e, insn->address, bytes, run);
+            next = insn->address + run;
+            if (status == EOF)
+                return EOF;
+            continue;
+        }
+        if (insn->address + insn->size > image_end) {
+            status = EmitAsmData(e, insn->address, ctx->data + (insn->address - ctx->base), image_end - insn->address);
+        } else if (ops[insn->opcode].operand == SYNTAX_WORD
+                   && (label = LabelName(user, &labels, insn->operand, scratch))) {
+            status = EmitAsmNamed(e, insn, label);
+        } else if ((status = EmitRoom(e)) == 0) {
+            const size_t from = e->len;
+            EmitInsn(e, insn);
+            Unaddress(e, from, insn->address);
+        }
+        if (status == EOF)
+            return EOF;
+        next = insn->address + insn->size;
+        ++i;
+    }
+    if (EmitText(e, "\tEND\n", 5) == EOF)
+        return EOF;
+    return EmitFlush(e);
+}
+
+/*
+ * cross-reference index: for every cpu address, the instructions that
+ * name it. The on-disk layout is a 16-byte header, offsets[0x10001] and
+ * then the sites, all little-endian, so the references to target t are
+ * sites[offsets[t]] up to sites[offsets[t + 1]] and a lookup reads only
+ * those. A site packs its address, opcode and kind into 32 bits
+ */
+#define XREF_MAGIC "I80X"
+#define XREF_VERSION 1
+#define XREF_HEADER_SIZE 16
+#define XREF_SITE_SIZE 4
+
+enum {
+    XREF_CALL,
+    XREF_JUMP,
+    XREF_READ,
+    XREF_WRITE,
+    XREF_ADDRESS,
+    XREF_RST,
+    XREF_KINDS,
+    XREF_NONE = XREF_KINDS,
+};
+
+static const char* const xref_kinds[XREF_KINDS] = {"call", "jump", "read", "write", "address", "rst"};
+
+typedef struct {
+    /* MEM_SIZE + 1 entries */
+    uint32_t* offsets;
+    /* address | opcode << 16 | kind << 24, by target and then address */
+    uint32_t* sites;
+    size_t count;
+} Xref;
+
+static int XrefKind(const Insn* insn) {
+    if (insn->flags & INSN_DATA)
+        return XREF_NONE;
+    if (insn->flags & OP_RST)
+        return XREF_RST;
+    if (insn->size != 3)
+        return XREF_NONE;
+    if (insn->flags & OP_CALL)
+        return XREF_CALL;
+    if (insn->flags & OP_JUMP)
+        return XREF_JUMP;
+    switch (insn->opcode) {
+        case 0x2a: /* LHLD */
+        case 0x3a: /* LDA */
+            return XREF_READ;
+        case 0x22: /* SHLD */
+        case 0x32: /* STA */
+            return XREF_WRITE;
+        default:
+            /* LXI */
+            return XREF_ADDRESS;
+    }
+}
+
+static inline uint16_t XrefTarget(const Insn* insn) {
+    return insn->flags & OP_RST ? insn->opcode & 0x38 : insn->operand;
+}
+
+/* what BuildXref() takes from the arena for n instructions */
+static size_t XrefBytes(size_t n) {
+    return (MEM_SIZE + 1) * sizeof(uint32_t) + n * sizeof(uint32_t) + 32;
+}
+
+/* a counting sort by target: the sites of one target keep the order of
+ * insns, which is address order */
+static int BuildXref(Xref* x, const Insn* insns, size_t n, Arena* arena) {
+    x->offsets = ArenaCalloc(arena, (MEM_SIZE + 1) * sizeof(uint32_t));
+    if (!x->offsets) {
+        return -1;
+    }
+    x->count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (XrefKind(&insns[i]) != XREF_NONE) {
+            x->offsets[XrefTarget(&insns[i])]++;
+            x->count++;
+        }
+    }
+    x->sites = ArenaAlloc(arena, (x->count ? x->count : 1) * sizeof(uint32_t));
+    if (!x->sites) {
+        return -1;
+    }
+    /* offsets[t] becomes the end of t's sites, and filling backwards
+     * walks it down to the start */
+    for (size_t t = 1; t <= MEM_SIZE; ++t)
+        x->offsets[t] += x->offsets[t - 1];
+    for (size_t i = n; i-- > 0;) {
+        const int kind = XrefKind(&insns[i]);
+        if (kind != XREF_NONE)
+            x->sites[--x->offsets[XrefTarget(&insns[i])]]
+                    = (insns[i].address & 0xffff) | (uint32_t)insns[i].opcode << 16 | (uint32_t)kind << 24;
+    }
+    return 0;
+}
+
+static int WriteXref(const char* path, const Xref* x) {
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        return EOF;
+    }
+    uint8_t buf[XREF_SITE_SIZE * 1024];
+    uint8_t* p = buf;
+    memcpy(p, XREF_MAGIC, 4);
+    p = PutLE16(p + 4, XREF_VERSION);
+    p = PutLE16(p, XREF_SITE_SIZE);
+    p = PutLE32(p, x->count);
+    p = PutLE32(p, 0);
+    int status = fwrite(buf, 1, XREF_HEADER_SIZE, out) == XREF_HEADER_SIZE ? 0 : EOF;
+    /* the offsets and then the sites, through one buffer */
+    const size_t total = MEM_SIZE + 1 + x->count;
+    for (size_t i = 0; i < total && status == 0;) {
+        p = buf;
+        for (; i < total && p < buf + sizeof(buf); ++i)
+            p = PutLE32(p, i <= MEM_SIZE ? x->offsets[i] : x->sites[i - MEM_SIZE - 1]);
+        if (fwrite(buf, 1, p - buf, out) != (size_t)(p - buf))
+            status = EOF;
+    }
+    if (fclose(out) == EOF)
+        status = EOF;
+    return status;
+}
+
+/* list every site that references target, straight from a saved index */
+static int QueryXref(Emitter* e, const Image* index, size_t target) {
+    const uint8_t* p = index->data;
+    if (index->size < XREF_HEADER_SIZE || memcmp(p, XREF_MAGIC, 4) || GetLE16(p + 4) != XREF_VERSION
+        || GetLE16(p + 6) != XREF_SITE_SIZE
+        || index->size != XREF_HEADER_SIZE + (MEM_SIZE + 1 + (size_t)GetLE32(p + 8)) * 4) {
+        errno = EINVAL;
+        return EOF;
+    }
+    const uint8_t* offsets = p + XREF_HEADER_SIZE;
+    const uint8_t* sites = offsets + (MEM_SIZE + 1) * 4;
+    const size_t begin = GetLE32(offsets + target * 4);
+    const size_t end = GetLE32(offsets + target * 4 + 4);
+    if (begin > end || end > GetLE32(p + 8)) {
+        errno = EINVAL;
+        return EOF;
+    }
+    size_t kinds[XREF_KINDS] = {0};
+    for (size_t i = begin; i < end; ++i)
+        if (sites[i * 4 + 3] < XREF_KINDS)
+            kinds[sites[i * 4 + 3]]++;
+    char line[128];
+    int len = snprintf(line, sizeof(line), "; %04zx: %zu reference%s", target, end - begin,
+                       end - begin == 1 ? "" : "s");
+    for (int kind = 0; kind < XREF_KINDS; ++kind)
+        if (kinds[kind])
+            len += snprintf(line + len, sizeof(line) - len, ", %zu %s", kinds[kind], xref_kinds[kind]);
+    line[len++] = '\n';
+    int status = EmitText(e, line, len);
+    for (size_t i = begin; i < end && status == 0; ++i) {
+        const uint8_t* site = sites + i * 4;
+        const Op* op = &disasm_ops[site[2]];
+        const Insn insn = {
+                .address = GetLE16(site),
+                .opcode = site[2],
+                .size = op->size,
+                .operand = target,
+                .flags = op->flags,
+        };
+        status = disasm_syntax[e->syntax][insn.opcode].operand == SYNTAX_WORD ? EmitNamed(e, &insn, NULL)
+                                                                               : EmitInsn(e, &insn);
+    }
+    return status == EOF ? EOF : EmitFlush(e);
+}
+
+/*
+ * control-flow graph: the decoded records split into basic blocks at
+ * branch and call targets and after every instruction that transfers
+ * control, with the edges between them in CSR form, edges[offsets[b]]
+ * up to edges[offsets[b + 1]] leaving block b. Everything is a flat
+ * array indexed by block number and built in a fixed number of passes
+ * over the records
+ */
+#define CFG_MAGIC "I80G"
+#define CFG_VERSION 1
+#define CFG_HEADER_SIZE 16
+
+enum {
+    CFG_FALL,   /* falls through, or returns from a call, to the next block */
+    CFG_JUMP,   /* JMP */
+    CFG_BRANCH, /* Jcc taken */
+    CFG_CALL,   /* CALL, Ccc and RST */
+    CFG_KINDS,
+};
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    /* its records are insns[first] up to insns[first + count] */
+    uint32_t first;
+    uint32_t count;
+} Block;
+
+typedef struct {
+    Block* blocks;
+    size_t n_blocks;
+    /* n_blocks + 1 entries */
+    uint32_t* offsets;
+    /* target block | kind << 24 */
+    uint32_t* edges;
+    size_t n_edges;
+} Cfg;
+
+/* what BuildCfg() takes from the arena for n records */
+static size_t CfgBytes(size_t n) {
+    return 2 * BITMAP_WORDS * sizeof(uint64_t) + MEM_SIZE * sizeof(uint32_t) + n * sizeof(Block)
+            + (n + 1) * sizeof(uint32_t) + 2 * n * sizeof(uint32_t) + 96;
+}
+
+/* the instruction never falls through to the next one */
+static inline int CfgStops(const Insn* insn) {
+    return insn->flags & OP_HALT || (insn->flags & (OP_JUMP | OP_RET) && !(insn->flags & OP_COND));
+}
+
+static inline int CfgEnds(const Insn* insn) {
+    return insn->flags & (OP_JUMP | OP_CALL | OP_RET | OP_RST | OP_HALT);
+}
+
+/* the block a direct jump, call or RST goes to, if any */
+static inline int CfgTarget(const Insn* insn, uint16_t* target) {
+    if (insn->flags & OP_RST) {
+        *target = insn->opcode & 0x38;
+        return 1;
+    }
+    *target = insn->operand;
+    return insn->size == 3 && insn->flags & (OP_JUMP | OP_CALL);
+}
+
+static int BuildCfg(Cfg* g, const Insn* insns, size_t n, Arena* arena) {
+    uint64_t* leaders = ArenaCalloc(arena, BITMAP_WORDS * sizeof(uint64_t));
+    uint64_t* heads = ArenaCalloc(arena, BITMAP_WORDS * sizeof(uint64_t));
+    /* only read where heads has a bit, so never cleared */
+    uint32_t* block_at = ArenaAlloc(arena, MEM_SIZE * sizeof(uint32_t));
+    g->blocks = ArenaAlloc(arena, (n ? n : 1) * sizeof(Block));
+    g->offsets = ArenaAlloc(arena, (n + 1) * sizeof(uint32_t));
+    g->edges = ArenaAlloc(arena, (n ? 2 * n : 1) * sizeof(uint32_t));
+    if (!leaders || !heads || !block_at || !g->blocks || !g->offsets || !g->edges) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        uint16_t target;
+        if (!(insns[i].flags & INSN_DATA) && CfgTarget(&insns[i], &target))
+            BitSet(leaders, target);
+    }
+
+    /* a block also starts after data, a gap, or anything that ends one */
+    g->n_blocks = 0;
+    Block* block = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        const Insn* insn = &insns[i];
+        if (insn->flags & INSN_DATA) {
+            block = NULL;
+            continue;
+        }
+        const uint16_t address = insn->address & 0xffff;
+        if (!block || block->end != insn->address || BitTest(leaders, address) || CfgEnds(&insns[i - 1])) {
+            block = &g->blocks[g->n_blocks];
+            *block = (Block){.start = insn->address, .end = insn->address, .first = i, .count = 0};
+            BitSet(heads, address);
+            block_at[address] = g->n_blocks++;
+        }
+        block->end += insn->size;
+        block->count++;
+    }
+
+    g->n_edges = 0;
+    for (size_t b = 0; b < g->n_blocks; ++b) {
+        const Insn* last = &insns[g->blocks[b].first + g->blocks[b].count - 1];
+        const uint32_t next = g->blocks[b].end;
+        uint16_t target;
+        g->offsets[b] = g->n_edges;
+        if (!CfgStops(last) && next < MEM_SIZE && BitTest(heads, next))
+            g->edges[g->n_edges++] = block_at[next] | (uint32_t)CFG_FALL << 24;
+        if (CfgTarget(last, &target) && BitTest(heads, target)) {
+            const int kind = last->flags & (OP_CALL | OP_RST) ? CFG_CALL
+                    : last->flags & OP_COND                 ? CFG_BRANCH
+                                                            : CFG_JUMP;
+            g->edges[g->n_edges++] = block_at[target] | (uint32_t)kind << 24;
+        }
+    }
+    g->offsets[g->n_blocks] = g->n_edges;
+    return 0;
+}
+
+static int WriteCfgBin(const char* path, const Cfg* g) {
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        return EOF;
+    }
+    uint8_t buf[4096];
+    uint8_t* p = buf;
+    memcpy(p, CFG_MAGIC, 4);
+    p = PutLE16(p + 4, CFG_VERSION);
+    p = PutLE16(p, 0);
+    p = PutLE32(p, g->n_blocks);
+    p = PutLE32(p, g->n_edges);
+    int status = fwrite(buf, 1, CFG_HEADER_SIZE, out) == CFG_HEADER_SIZE ? 0 : EOF;
+    /* start and end of each block, then the offsets, then the edges */
+    const size_t total = 2 * g->n_blocks + g->n_blocks + 1 + g->n_edges;
+    for (size_t i = 0; i < total && status == 0;) {
+        p = buf;
+        for (; i < total && p < buf + sizeof(buf); ++i) {
+            uint32_t v;
+            if (i < 2 * g->n_blocks)
+                v = i & 1 ? g->blocks[i / 2].end : g->blocks[i / 2].start;
+            else if (i < 3 * g->n_blocks + 1)
+                v = g->offsets[i - 2 * g->n_blocks];
+            else
+                v = g->edges[i - 3 * g->n_blocks - 1];
+            p = PutLE32(p, v);
+        }
+        if (fwrite(buf, 1, p - buf, out) != (size_t)(p - buf))
+            status = EOF;
+    }
+    if (fclose(out) == EOF)
+        status = EOF;
+    return status;
+}
+
+static int WriteCfgDot(const char* path, const Cfg* g) {
+    static const char* const styles[CFG_KINDS] = {
+            "style=dashed", "", "color=darkgreen", "color=blue",
+    };
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        return EOF;
+    }
+    fputs("digraph cfg {\n    node [shape=box, fontname=\"monospace\"];\n", out);
+    for (size_t b = 0; b < g->n_blocks; ++b)
+        fprintf(out, "    b%" PRIx32 " [label=\"%04" PRIx32 "-%04" PRIx32 "\\n%" PRIu32 " insn%s\"];\n",
+                g->blocks[b].start, g->blocks[b].start, g->blocks[b].end - 1, g->blocks[b].count,
+                g->blocks[b].count == 1 ? "" : "s");
+    for (size_t b = 0; b < g->n_blocks; ++b) {
+        for (size_t k = g->offsets[b]; k < g->offsets[b + 1]; ++k) {
+            const Block* to = &g->blocks[g->edges[k] & 0xffffff];
+            fprintf(out, "    b%" PRIx32 " -> b%" PRIx32 " [%s];\n", g->blocks[b].start, to->start,
+                    styles[g->edges[k] >> 24]);
+        }
+    }
+    fputs("}\n", out);
+    const int status = ferror(out) ? EOF : 0;
+    return fclose(out) == EOF ? EOF : status;
+}
+
+/*
+ * the small assembler behind --verify. It reads what EmitAsm() writes and
+ * a little more: "NAME:" labels, NAME EQU n, ORG, END, DB with numbers
+ * and quoted text, DW with numbers and names, DS n[,fill], and every
+ * instruction of the asm syntax. Numbers are decimal, or hex with an h
+ * suffix. It makes one pass over the text and patches forward references
+ * at the end. Opcodes are looked up by their text in a table built from
+ * disasm_syntax[SYNTAX_ASM], so it always agrees with the listing about
+ * an encoding
+ */
+#define ASM_KEY_MAX 16
+#define ASM_OPCODE_SLOTS 512
+
+/* the text of an opcode, zero-padded, so two loads compare it */
+typedef union {
+    char text[ASM_KEY_MAX];
+    uint64_t words[2];
+} AsmKeyWords;
+
+typedef struct {
+    AsmKeyWords key;
+    uint8_t opcode;
+    uint8_t used;
+} AsmOpcode;
+
+typedef struct {
+    /* points into the text */
+    const char* name;
+    size_t len;
+    uint16_t value;
+} AsmName;
+
+/* a name used before its definition, filled in at the end */
+typedef struct {
+    const char* name;
+    size_t len;
+    size_t line;
+    uint16_t at;
+    uint8_t size;
+} AsmFixup;
+
+typedef struct {
+    /* the bytes the text assembles to, and which of them it set */
+    uint8_t mem[MEM_SIZE];
+    uint64_t written[BITMAP_WORDS];
+    size_t pc;
+    AsmOpcode opcodes[ASM_OPCODE_SLOTS];
+    AsmName* names;
+    size_t names_mask;
+    size_t n_names;
+    AsmFixup* fixups;
+    size_t n_fixups;
+    size_t max_fixups;
+    Arena* arena;
+    /* the line being assembled, and what is wrong with it if anything */
+    size_t line;
+    const char* error;
+} Assembler;
+
+static inline uint32_t AsmHash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+static AsmOpcode* AsmOpcodeSlot(Assembler* a, const AsmKeyWords* k) {
+    size_t i = (k->words[0] * 0x9e3779b97f4a7c15ull ^ k->words[1] * 0xc2b2ae3d27d4eb4full) >> 55;
+    while (a->opcodes[i].used
+           && (a->opcodes[i].key.words[0] != k->words[0] || a->opcodes[i].key.words[1] != k->words[1]))
+        i = (i + 1) & (ASM_OPCODE_SLOTS - 1);
+    return &a->opcodes[i];
+}
+
+/* the first len characters of a key */
+static inline AsmKeyWords AsmKeyPrefix(const AsmKeyWords* k, size_t len) {
+    AsmKeyWords prefix = *k;
+    if (len < 8) {
+        prefix.words[0] &= len ? ~0ull >> (64 - 8 * len) : 0;
+        prefix.words[1] = 0;
+    } else if (len < 16) {
+        prefix.words[1] &= len > 8 ? ~0ull >> (128 - 8 * len) : 0;
+    }
+    return prefix;
+}
+
+/* every opcode under the text in front of its operand, or its whole text
+ * when it has none: "MVI\tB," and "MOV\tB,C" */
+static void AsmOpcodes(Assembler* a) {
+    const SyntaxOp* ops = disasm_syntax[SYNTAX_ASM];
+    for (int opcode = 0; opcode < 256; ++opcode) {
+        const SyntaxOp* op = &ops[opcode];
+        if (op->operand == SYNTAX_OPCODE)
+            continue;
+        const size_t len = op->operand == SYNTAX_NONE ? op->head_len : op->head_len - op->prefix_len;
+        AsmKeyWords key = {{0}};
+        memcpy(key.text, op->head, len);
+        AsmOpcode* slot = AsmOpcodeSlot(a, &key);
+        slot->key = key;
+        slot->opcode = opcode;
+        slot->used = 1;
+    }
+}
+
+/* the slot of a name, or the empty one where it would go */
+static AsmName* AsmNameSlot(Assembler* a, const char* name, size_t len) {
+    size_t i = AsmHash(name, len) & a->names_mask;
+    while (a->names[i].name && (a->names[i].len != len || memcmp(a->names[i].name, name, len)))
+        i = (i + 1) & a->names_mask;
+    return &a->names[i];
+}
+
+static inline const char* AsmFail(Assembler* a, const char* error) {
+    a->error = error;
+    return NULL;
+}
+
+static inline int AsmPut(Assembler* a, uint8_t byte) {
+    if (a->pc >= MEM_SIZE) {
+        a->error = "runs past the end of the cpu memory";
+        return -1;
+    }
+    a->mem[a->pc] = byte;
+    BitSet(a->written, a->pc++);
+    return 0;
+}
+
+static inline int AsmNameChar(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '?'
+           || c == '@' || c == '.' || c == '$';
+}
+
+static inline const char* AsmSkipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+/* the number or name at p. A name not defined yet is patched in at the
+ * end as size bytes at the pc, and is an error when size is 0. Returns
+ * where it ends, or NULL */
+static const char* AsmValue(Assembler* a, const char* p, const char* end, size_t* value, int size) {
+    const char* q = p;
+    while (q < end && AsmNameChar(*q))
+        ++q;
+    if (q == p) {
+        a->error = "expected a number or a name";
+        return NULL;
+    }
+    if (*p >= '0' && *p <= '9') {
+        const int hex = q[-1] == 'h' || q[-1] == 'H';
+        size_t v = 0;
+        for (const char* c = p; c < q - hex; ++c) {
+            const int digit = HexDigit(*c);
+            if (digit < 0 || (!hex && digit > 9) || v > 0xffff) {
+                a->error = "bad number";
+                return NULL;
+            }
+            v = v * (hex ? 16 : 10) + digit;
+        }
+        *value = v;
+        return q;
+    }
+    const AsmName* name = AsmNameSlot(a, p, q - p);
+    if (name->name) {
+        *value = name->value;
+        return q;
+    }
+    if (!size) {
+        a->error = "name used before it is defined";
+        return NULL;
+    }
+    if (a->n_fixups == a->max_fixups) {
+        const size_t max = a->max_fixups ? 2 * a->max_fixups : 256;
+        AsmFixup* grown = ArenaAlloc(a->arena, max * sizeof(AsmFixup));
+        if (!grown) {
+            a->error = "out of memory";
+            return NULL;
+        }
+        if (a->n_fixups)
+            memcpy(grown, a->fixups, a->n_fixups * sizeof(AsmFixup));
+        a->fixups = grown;
+        a->max_fixups = max;
+    }
+    a->fixups[a->n_fixups++] = (AsmFixup){.name = p, .len = q - p, .line = a->line, .at = a->pc, .size = size};
+    *value = 0;
+    return q;
+}
+
+/* a value put at the pc as size bytes, little-endian */
+static const char* AsmOperand(Assembler* a, const char* p, const char* end, int size) {
+    size_t v;
+    p = AsmValue(a, AsmSkipSpace(p, end), end, &v, size);
+    if (!p)
+        return NULL;
+    if (v >> (size * 8)) {
+        a->error = "value out of range";
+        return NULL;
+    }
+    if (AsmPut(a, v) < 0 || (size == 2 && AsmPut(a, v >> 8) < 0))
+        return NULL;
+    return AsmSkipSpace(p, end);
+}
+
+/* the end of a statement: nothing but a comment may follow. Returns
+ * where the line ends, or NULL */
+static const char* AsmEnd(Assembler* a, const char* p, const char* end) {
+    p = AsmSkipSpace(p, end);
+    if (p < end && *p == ';') {
+        p = memchr(p, '\n', end - p);
+        return p ? p : end;
+    }
+    return p == end || *p == '\n' ? p : AsmFail(a, "unexpected text after the statement");
+}
+
+static const char* AsmData(Assembler* a, const char* p, const char* end, int size) {
+    for (;;) {
+        p = AsmSkipSpace(p, end);
+        if (size == 1 && p < end && *p == '\'') {
+            for (++p;; ++p) {
+                if (p == end || *p == '\n')
+                    return AsmFail(a, "text without its closing quote");
+                if (*p == '\'' && (p + 1 == end || p[1] != '\''))
+                    break;
+                p += *p == '\'';
+                if (AsmPut(a, *p) < 0)
+                    return NULL;
+            }
+            p = AsmSkipSpace(p + 1, end);
+        } else if (!(p = AsmOperand(a, p, end, size))) {
+            return NULL;
+        }
+        if (p == end || *p != ',')
+            return AsmEnd(a, p, end);
+        ++p;
+    }
+}
+
+static inline char AsmUpper(char c) {
+    return c >= 'a' && c <= 'z' ? c - 0x20 : c;
+}
+
+/* one instruction or directive; returns where its line ends, or NULL */
+static const char* AsmStatement(Assembler* a, const char* p, const char* end, int* done) {
+    /* the mnemonic and the operands, upper case and without spaces, to
+     * look the opcode up by; head is how much of it comes before the
+     * last comma or the tab, where the operand starts */
+    AsmKeyWords key = {{0}};
+    size_t len = 0;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != ';') {
+        if (len == ASM_KEY_MAX - 1)
+            return AsmFail(a, "unknown instruction");
+        key.text[len++] = AsmUpper(*p++);
+    }
+    const char* const mnemonic = key.text;
+    if (len == 3 && !memcmp(mnemonic, "END", 3)) {
+        *done = 1;
+        return AsmEnd(a, p, end);
+    }
+    if (len == 3 && !memcmp(mnemonic, "ORG", 3)) {
+        size_t v;
+        if (!(p = AsmValue(a, AsmSkipSpace(p, end), end, &v, 0)))
+            return NULL;
+        a->pc = v;
+        return AsmEnd(a, p, end);
+    }
+    if (len == 2 && mnemonic[0] == 'D' && (mnemonic[1] == 'B' || mnemonic[1] == 'W'))
+        return AsmData(a, p, end, mnemonic[1] == 'B' ? 1 : 2);
+    if (len == 2 && mnemonic[0] == 'D' && mnemonic[1] == 'S') {
+        size_t count, fill = 0;
+        if (!(p = AsmValue(a, AsmSkipSpace(p, end), end, &count, 0)))
+            return NULL;
+        p = AsmSkipSpace(p, end);
+        if (p < end && *p == ',' && !(p = AsmValue(a, AsmSkipSpace(p + 1, end), end, &fill, 0)))
+            return NULL;
+        if (fill > 0xff)
+            return AsmFail(a, "value out of range");
+        for (size_t i = 0; i < count; ++i)
+            if (AsmPut(a, fill) < 0)
+                return NULL;
+        return AsmEnd(a, p, end);
+    }
+
+    p = AsmSkipSpace(p, end);
+    const char* operand = p;
+    size_t head = 0;
+    int fits = 1;
+    if (p < end && *p != '\n' && *p != ';') {
+        key.text[len++] = '\t';
+        head = len;
+        for (; p < end && *p != '\n' && *p != ';'; ++p) {
+            if (*p == ' ' || *p == '\t' || *p == '\r')
+                continue;
+            if (len == ASM_KEY_MAX)
+                fits = 0;
+            else
+                key.text[len++] = AsmUpper(*p);
+            if (*p == ',') {
+                head = fits ? len : 0;
+                operand = p + 1;
+            }
+        }
+    }
+    const AsmOpcode* op = fits ? AsmOpcodeSlot(a, &key) : NULL;
+    if (op && op->used && disasm_syntax[SYNTAX_ASM][op->opcode].operand == SYNTAX_NONE)
+        return AsmPut(a, op->opcode) < 0 ? NULL : AsmEnd(a, p, end);
+    if (!head)
+        return AsmFail(a, "unknown instruction");
+    const AsmKeyWords prefix = AsmKeyPrefix(&key, head);
+    op = AsmOpcodeSlot(a, &prefix);
+    if (!op->used || disasm_syntax[SYNTAX_ASM][op->opcode].operand == SYNTAX_NONE)
+        return AsmFail(a, "unknown instruction");
+    if (AsmPut(a, op->opcode) < 0)
+        return NULL;
+    const int size = disasm_syntax[SYNTAX_ASM][op->opcode].operand == SYNTAX_WORD ? 2 : 1;
+    return (p = AsmOperand(a, operand, end, size)) ? AsmEnd(a, p, end) : NULL;
+}
+
+/* make room for one more name, doubling the table when it is half full */
+static int AsmNameRoom(Assembler* a) {
+    if ((a->n_names + 1) * 2 <= a->names_mask + 1)
+        return 0;
+    const size_t slots = a->names ? 2 * (a->names_mask + 1) : 256;
+    AsmName* old = a->names;
+    const size_t old_slots = old ? a->names_mask + 1 : 0;
+    a->names = ArenaCalloc(a->arena, slots * sizeof(AsmName));
+    if (!a->names)
+        return -1;
+    a->names_mask = slots - 1;
+    for (size_t i = 0; i < old_slots; ++i)
+        if (old[i].name)
+            *AsmNameSlot(a, old[i].name, old[i].len) = old[i];
+    return 0;
+}
+
+/* assemble len bytes of text into a. Returns -1 with a->line and
+ * a->error set when it cannot */
+static int Assemble(Assembler* a, const char* text, size_t len) {
+    AsmOpcodes(a);
+    if (AsmNameRoom(a) < 0) {
+        a->error = "out of memory";
+        return -1;
+    }
+    const char* const end = text + len;
+    int done = 0;
+    for (const char* p = text; p < end && !done; ++p) {
+        ++a->line;
+        if (AsmNameChar(*p)) {
+            /* NAME: or NAME EQU n at the start of the line */
+            const char* name = p;
+            while (p < end && AsmNameChar(*p))
+                ++p;
+            const size_t name_len = p - name;
+            if (AsmNameRoom(a) < 0) {
+                a->error = "out of memory";
+                return -1;
+            }
+            AsmName* slot = AsmNameSlot(a, name, name_len);
+            if (slot->name) {
+                a->error = "name defined twice";
+                return -1;
+            }
+            size_t value = a->pc;
+            if (p < end && *p == ':') {
+                ++p;
+            } else {
+                p = AsmSkipSpace(p, end);
+                if (end - p < 3 || (p[0] | 0x20) != 'e' || (p[1] | 0x20) != 'q' || (p[2] | 0x20) != 'u') {
+                    a->error = "expected NAME: or NAME EQU value";
+                    return -1;
+                }
+                if (!(p = AsmValue(a, AsmSkipSpace(p + 3, end), end, &value, 0)) || !(p = AsmEnd(a, p, end)))
+                    return -1;
+                if (value > 0xffff) {
+                    a->error = "value out of range";
+                    return -1;
+                }
+            }
+            *slot = (AsmName){.name = name, .len = name_len, .value = value};
+            ++a->n_names;
+        }
+        p = AsmSkipSpace(p, end);
+        if (p < end && *p != '\n' && !(p = *p == ';' ? AsmEnd(a, p, end) : AsmStatement(a, p, end, &done)))
+            return -1;
+    }
+
+    for (size_t i = 0; i < a->n_fixups; ++i) {
+        const AsmFixup* f = &a->fixups[i];
+        const AsmName* name = AsmNameSlot(a, f->name, f->len);
+        a->line = f->line;
+        if (!name->name) {
+            a->error = "name never defined";
+            return -1;
+        }
+        if (f->size == 1 && name->value > 0xff) {
+            a->error = "value out of range";
+            return -1;
+        }
+        a->mem[f->at] = name->value;
+        if (f->size == 2)
+            a->mem[(f->at + 1) & 0xffff] = name->value >> 8;
+    }
+    return 0;
+}
+
+/* compare what the listing assembled to with the bytes it lists, which
+ * are those of the records clipped to the image */
+static int CompareAssembled(const Emitter* e, const Assembler* a, const Insn* insns, size_t n,
+                            const DisasmContext* ctx, Arena* arena, const char* program_name) {
+    uint64_t* listed = ArenaCalloc(arena, BITMAP_WORDS * sizeof(uint64_t));
+    if (!listed) {
+        return EOF;
+    }
+    const size_t image_end = ctx->base + ctx->size;
+    for (size_t i = 0; i < n; ++i) {
+        const size_t end = insns[i].address + (insns[i].flags & INSN_DATA ? 1 : insns[i].size);
+        for (size_t address = insns[i].address; address < end && address < image_end; ++address)
+            BitSet(listed, address);
+    }
+    for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+        const uint64_t extra = a->written[w] & ~listed[w];
+        const uint64_t missing = listed[w] & ~a->written[w];
+        if (extra || missing) {
+            const size_t address = w * 64 + __builtin_ctzll(extra | missing);
+            fprintf(stderr, "%s: %s: the listing %s %04zx\n", program_name, e->name,
+                    BitTest(a->written, address) ? "assembles a byte the image does not have at" : "leaves out",
+                    address);
+            errno = 0;
+            return EOF;
+        }
+        for (uint64_t bits = listed[w]; bits; bits &= bits - 1) {
+            const size_t address = w * 64 + __builtin_ctzll(bits);
+            const uint8_t byte = ctx->data[address - ctx->base];
+            if (a->mem[address] != byte) {
+                fprintf(stderr, "%s: %s: the listing assembles %02x at %04zx where the image has %02x\n",
+                        program_name, e->name, a->mem[address], address, byte);
+                errno = 0;
+                return EOF;
+            }
+        }
+    }
+    return 0;
+}
+
+/* --asm and --verify: the asm listing goes to memory first when it is to
+ * be assembled again, and out to e only once it has been checked */
+static int WriteAsm(Emitter* e, const Insn* insns, size_t n, const DisasmContext* ctx, const Options* options,
+                    Arena* arena) {
+    if (!options->verify)
+        return EmitAsm(e, insns, n, ctx, options->symbols, arena);
+    char* text = NULL;
+    size_t len = 0;
+    FILE* memory = open_memstream(&text, &len);
+    Emitter* listing = memory ? ArenaAlloc(arena, sizeof(Emitter)) : NULL;
+    Assembler* a = listing ? ArenaCalloc(arena, sizeof(Assembler)) : NULL;
+    if (!a) {
+        if (memory)
+            fclose(memory);
+        free(text);
+        return EOF;
+    }
+    EmitterInit(listing, memory, SYNTAX_ASM);
+    listing->stats = NULL;
+    listing->arena = arena;
+    listing->name = e->name;
+    int status = EmitAsm(listing, insns, n, ctx, options->symbols, arena);
+    if (fclose(memory) == EOF)
+        status = EOF;
+    if (status == 0) {
+        a->arena = arena;
+        if (Assemble(a, text, len) < 0) {
+            fprintf(stderr, "%s: %s: line %zu of the listing %s\n", options->program_name, e->name, a->line,
+                    a->error);
+            errno = 0;
+            status = EOF;
+        } else {
+            status = CompareAssembled(e, a, insns, n, ctx, arena, options->program_name);
+        }
+    }
+    if (status == 0 && options->reassemble)
+        status = EmitFlush(e) == EOF || EmitterWrite(e, text, len) == EOF ? EOF : 0;
+    free(text);
+    return status;
+}
+
+/* --assemble: the bytes the source sets, from the lowest address it sets
+ * to the highest, with zeros in any gap between */
+static int WriteAssembled(Emitter* e, const Image* source, Arena* arena, const char* program_name) {
+    Assembler* a = ArenaCalloc(arena, sizeof(Assembler));
+    if (!a)
+        return EOF;
+    a->arena = arena;
+    if (Assemble(a, (const char*)source->data, source->size) < 0) {
+        fprintf(stderr, "%s: %s: line %zu: %s\n", program_name, e->name, a->line, a->error);
+        errno = 0;
+        return EOF;
+    }
+    size_t first = MEM_SIZE;
+    size_t last = 0;
+    for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+        if (!a->written[w])
+            continue;
+        if (first == MEM_SIZE)
+            first = w * 64 + __builtin_ctzll(a->written[w]);
+        last = w * 64 + 64 - __builtin_clzll(a->written[w]);
+    }
+    if (first < last && EmitterWrite(e, (const char*)a->mem + first, last - first) == EOF)
+        return EOF;
+    return EmitFlush(e);
+}
+
+/* what EmitAsm() and, for --verify, the assembler take on top of the rest */
+static size_t AsmBytes(const Options* options, size_t size) {
+    if (!options->reassemble && !options->verify)
+        return 0;
+    size_t bytes = BITMAP_WORDS * sizeof(uint64_t);
+    if (options->verify) {
+        /* at most a label for every three bytes, in a names table that
+         * leaves its smaller copies behind as it doubles */
+        bytes += sizeof(Emitter) + sizeof(Assembler) + BITMAP_WORDS * sizeof(uint64_t)
+                + 2 * SymbolSlots(size / 3 + 8) * sizeof(AsmName);
+    }
+    return bytes;
+}
+
+/* everything DecodeAndWrite() takes from the arena for an image of size
+ * bytes, so that one block holds the whole run */
+static size_t ArenaSizeFor(const Options* options, size_t size) {
+    return (size + 1) * sizeof(Insn) + sizeof(Traversal) + BITMAP_WORDS * sizeof(uint64_t)
+            + SymbolBytes(size / 3 + 1) + (options->xref ? XrefBytes(size + 1) : 0)
+            + (options->cfg_dot || options->cfg_bin ? CfgBytes(size + 1) : 0) + AsmBytes(options, size) + 64;
+}
+
+static int DecodeAndWrite(Emitter* e, const Image* image, const Options* options) {
+    /* an emitter without an arena of its own gets one for this run */
+    Arena local = {0};
+    Arena* arena = e->arena ? e->arena : &local;
+    const DisasmContext ctx = ImageContext(image, options->offset);
+    const size_t ranged = options->n_ranges ? RangeRecords(&ctx, options) + 1 : 0;
+    Insn* insns = ArenaReserve(arena, ArenaSizeFor(options, image->size)) == 0
+            ? ArenaAlloc(arena, (ranged && !Marked(options) ? ranged : image->size + 1) * sizeof(Insn)) : NULL;
+    if (!insns) {
+        ArenaFree(&local);
+        return EOF;
+    }
+    const size_t start = options->offset + options->jump;
+    const double t0 = Now();
+    size_t n;
+    if (Marked(options)) {
+        n = DecodeMarked(image, options, insns, arena);
+        if (ranged) {
+            Insn* picked = ArenaAlloc(arena, ranged * sizeof(Insn));
+            if (!picked) {
+                ArenaFree(&local);
+                return EOF;
+            }
+            n = SelectRanges(&ctx, options, insns, n, picked);
+            insns = picked;
+        }
+    } else if (ranged) {
+        n = DecodeRanges(&ctx, options, insns, ranged);
+    } else {
+        n = DecodeRange(&ctx, start, ctx.base + ctx.size, insns, image->size + 1, NULL);
+    }
+    if (e->stats)
+        StatsCount(e->stats, insns, n);
+    if (options->xref) {
+        Xref xref;
+        if (BuildXref(&xref, insns, n, arena) < 0 || WriteXref(options->xref, &xref) == EOF) {
+            perror(options->xref);
+            ArenaFree(&local);
+            errno = 0;
+            return EOF;
+        }
+    }
+    if (options->cfg_dot || options->cfg_bin) {
+        Cfg cfg;
+        const char* failed = BuildCfg(&cfg, insns, n, arena) < 0 ? "cfg" : NULL;
+        if (!failed && options->cfg_dot && WriteCfgDot(options->cfg_dot, &cfg) == EOF)
+            failed = options->cfg_dot;
+        if (!failed && options->cfg_bin && WriteCfgBin(options->cfg_bin, &cfg) == EOF)
+            failed = options->cfg_bin;
+        if (failed) {
+            perror(failed);
+            ArenaFree(&local);
+            errno = 0;
+            return EOF;
+        }
+    }
+    const double t1 = Now();
+    int status;
+    if (options->format == FORMAT_BIN)
+        status = WriteRecords(e->file, insns, n);
+    else if (options->reassemble || options->verify)
+        status = WriteAsm(e, insns, n, &ctx, options, arena);
+    else if (options->labels)
+        status = EmitLabeled(e, insns, n, options->symbols, arena);
+    else
+        status = EmitRecords(e, insns, n);
+    if (e->stats) {
+        e->stats->decode_seconds += t1 - t0;
+        e->stats->format_seconds += Now() - t1;
+    }
+    ArenaFree(&local);
+    return status;
+}
+
+/*
+ * --emit: one decode feeding several renderers at once. The decoder
+ * fills batches of records into a ring of slots and every renderer reads
+ * every batch on a thread of its own. A slot is only refilled once all
+ * of them are past it, so the slowest renderer sets the pace and the
+ * ring never grows
+ */
+#define EMIT_SLOTS 8
+#define EMIT_BATCH 1024
+
+typedef struct {
+    Insn insns[EMIT_BATCH];
+    size_t n;
+} EmitBatch;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EmitBatch slots[EMIT_SLOTS];
+    /* batches published so far, and how many each renderer is done with */
+    size_t produced;
+    size_t consumed[MAX_EMITS];
+    int done;
+} EmitQueue;
+
+typedef struct {
+    EmitQueue* queue;
+    size_t index;
+    int kind;
+    const char* path;
+    FILE* file;
+    /* buffers text and json lines */
+    Emitter* e;
+    /* records written, for the header of a bin file, and where it is */
+    size_t count;
+    long header;
+    int error;
+} Renderer;
+
+/* where the decoder takes its batches from: records a traversal made up
+ * front, or a sweep over the ranges */
+typedef struct {
+    const DisasmContext* ctx;
+    const Options* options;
+    const Insn* insns;
+    size_t n;
+    size_t next;
+    size_t range;
+    size_t address;
+    size_t end;
+} EmitSource;
+
+static size_t NextBatch(EmitSource* s, Insn* out) {
+    if (s->insns) {
+        /* never cut a DB line in two: EmitRecords() starts a new one
+         * at every batch */
+        size_t k = 0;
+        size_t line = 0;
+        for (; k < EMIT_BATCH && s->next + k < s->n; ++k) {
+            const Insn* insn = &s->insns[s->next + k];
+            if (insn->flags & INSN_DATA && line && line < 8 && insn->address == insn[-1].address + 1)
+                ++line;
+            else
+                line = insn->flags & INSN_DATA ? 1 : 0;
+        }
+        if (s->next + k < s->n && line && line < 8) {
+            const Insn* insn = &s->insns[s->next + k];
+            if (insn->flags & INSN_DATA && insn->address == insn[-1].address + 1)
+                k -= line;
+        }
+        memcpy(out, s->insns + s->next, k * sizeof(Insn));
+        s->next += k;
+        return k;
+    }
+    while (s->address >= s->end) {
+        if (s->range == s->options->n_ranges)
+            return 0;
+        if (!ResolveRange(s->ctx, s->options, s->range++, &s->address, &s->end))
+            s->end = 0;
+    }
+    return DecodeRange(s->ctx, s->address, s->end, out, EMIT_BATCH, &s->address);
+}
+
+static inline char* PutDecimal(char* p, uint32_t v) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+/* one object per record: address, size, the bytes in hex and the
+ * listing text without its address */
+static int EmitJson(Emitter* e, const Insn* insns, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const Insn* insn = &insns[i];
+        char text[DISASM_LINE_MAX];
+        const size_t len = insn->flags & INSN_DATA
+                ? FormatDataSyntax(text, e->syntax, insn->address, &insn->opcode, 1)
+                : e->format(text, insn);
+        const char* body = strchr(text, ':') + 2;
+        char line[DISASM_LINE_MAX * 2 + 64];
+        char* p = line;
+        memcpy(p, "{\"address\":", 11);
+        p = PutDecimal(p + 11, insn->address);
+        memcpy(p, ",\"size\":", 8);
+        p = PutDecimal(p + 8, insn->size);
+        memcpy(p, ",\"bytes\":\"", 10);
+        p = DisasmPutHex(p + 10, insn->opcode);
+        if (insn->size > 1)
+            p = DisasmPutHex(p, insn->operand & 0xff);
+        if (insn->size > 2)
+            p = DisasmPutHex(p, insn->operand >> 8);
+        memcpy(p, "\",\"text\":\"", 10);
+        p += 10;
+        for (const char* c = body; c < text + len - 1; ++c) {
+            if (*c == '\t') {
+                *p++ = '\\';
+                *p++ = 't';
+            } else {
+                if (*c == '"' || *c == '\\')
+                    *p++ = '\\';
+                *p++ = *c;
+            }
+        }
+        memcpy(p, "\"}\n", 3);
+        if (EmitText(e, line, p + 3 - line) == EOF)
+            return EOF;
+    }
+    return EmitFlush(e);
+}
+
+static int EmitRecordBatch(Renderer* r, const Insn* insns, size_t n) {
+    uint8_t buf[RECORD_SIZE * 256];
+    for (size_t i = 0; i < n;) {
+        uint8_t* p = buf;
+        for (; i < n && p < buf + sizeof(buf); ++i)
+            p = PutRecord(p, &insns[i]);
+        if (fwrite(buf, 1, p - buf, r->file) != (size_t)(p - buf))
+            return EOF;
+    }
+    r->count += n;
+    return 0;
+}
+
+static int RenderBatch(Renderer* r, const Insn* insns, size_t n) {
+    switch (r->kind) {
+        case EMIT_JSON:
+            return EmitJson(r->e, insns, n);
+        case EMIT_BIN:
+            return EmitRecordBatch(r, insns, n);
+        default:
+            return EmitRecords(r->e, insns, n);
+    }
+}
+
+static void* RenderWorker(void* arg) {
+    Renderer* r = arg;
+    EmitQueue* q = r->queue;
+    for (size_t next = 0;; ++next) {
+        pthread_mutex_lock(&q->lock);
+        while (next == q->produced && !q->done)
+            pthread_cond_wait(&q->cond, &q->lock);
+        const int finished = next == q->produced;
+        pthread_mutex_unlock(&q->lock);
+        if (finished)
+            break;
+        /* the slot stays put until this renderer says it is done with it;
+         * after an error the batches are still taken, so the decoder
+         * never waits on a renderer that has given up */
+        const EmitBatch* batch = &q->slots[next % EMIT_SLOTS];
+        if (!r->error && RenderBatch(r, batch->insns, batch->n) == EOF)
+            r->error = errno ? errno : EIO;
+        pthread_mutex_lock(&q->lock);
+        q->consumed[r->index] = next + 1;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+    return NULL;
+}
+
+/* the bin header goes out first with no count, which is filled in at
+ * the end; that needs a file that can seek, so a pipe is turned away
+ * before a byte reaches it */
+static int OpenRenderer(Renderer* r, const Options* options) {
+    r->file = strcmp(r->path, "-") ? fopen(r->path, "wb") : stdout;
+    if (!r->file) {
+        return EOF;
+    }
+    if (r->kind == EMIT_BIN) {
+        r->header = ftell(r->file);
+        if (r->header < 0)
+            return EOF;
+        uint8_t header[RECORD_HEADER_SIZE];
+        PutRecordHeader(header, 0);
+        return fwrite(header, 1, sizeof(header), r->file) == sizeof(header) ? 0 : EOF;
+    }
+    r->e = malloc(sizeof(Emitter));
+    if (!r->e) {
+        return EOF;
+    }
+    EmitterInit(r->e, r->file, options->syntax);
+    r->e->stats = NULL;
+    r->e->arena = NULL;
+    return 0;
+}
+
+static int CloseRenderer(Renderer* r) {
+    int status = r->error ? EOF : 0;
+    if (r->kind == EMIT_BIN && status == 0) {
+        uint8_t count[4];
+        PutLE32(count, r->count);
+        if (fflush(r->file) == EOF || fseek(r->file, r->header + 8, SEEK_SET) < 0 || fwrite(count, 1, 4, r->file) != 4)
+            status = EOF;
+    }
+    if (r->file == stdout ? fflush(r->file) == EOF : fclose(r->file) == EOF)
+        status = EOF;
+    free(r->e);
+    return status;
+}
+
+static int EmitFormats(Emitter* e, const Image* image, const Options* options) {
+    Arena local = {0};
+    Arena* arena = e->arena ? e->arena : &local;
+    const DisasmContext ctx = ImageContext(image, options->offset);
+    EmitSource source = {.ctx = &ctx, .options = options};
+    const double t0 = Now();
+    if (Marked(options)) {
+        const size_t ranged = options->n_ranges ? RangeRecords(&ctx, options) + 1 : 0;
+        Insn* insns = ArenaReserve(arena, ArenaSizeFor(options, image->size)) == 0
+                ? ArenaAlloc(arena, (image->size + 1 + ranged) * sizeof(Insn)) : NULL;
+        if (!insns) {
+            ArenaFree(&local);
+            return EOF;
+        }
+        source.n = DecodeMarked(image, options, insns, arena);
+        source.insns = insns;
+        if (ranged) {
+            source.insns = insns + image->size + 1;
+            source.n = SelectRanges(&ctx, options, insns, source.n, insns + image->size + 1);
+        }
+    } else if (!options->n_ranges) {
+        source.address = options->offset + options->jump;
+        source.end = ctx.base + ctx.size;
+    }
+    double decode_seconds = Now() - t0;
+
+    EmitQueue* q = malloc(sizeof(EmitQueue));
+    Renderer renderers[MAX_EMITS] = {0};
+    pthread_t workers[MAX_EMITS];
+    size_t started = 0;
+    int status = q ? 0 : EOF;
+    if (q) {
+        pthread_mutex_init(&q->lock, NULL);
+        pthread_cond_init(&q->cond, NULL);
+        q->produced = 0;
+        q->done = 0;
+        memset(q->consumed, 0, sizeof(q->consumed));
+    }
+    for (size_t i = 0; i < options->n_emits && status == 0; ++i) {
+        Renderer* r = &renderers[i];
+        r->queue = q;
+        r->index = i;
+        r->kind = options->emits[i].kind;
+        r->path = options->emits[i].path;
+        if (OpenRenderer(r, options) == EOF) {
+            perror(r->path);
+            status = EOF;
+            /* reported once, here, and not again when the rest close */
+            if (r->file) {
+                r->error = EIO;
+                CloseRenderer(r);
+                r->file = NULL;
+            }
+        } else if ((errno = pthread_create(&workers[i], NULL, RenderWorker, r))) {
+            perror("pthread_create");
+            status = EOF;
+        } else {
+            started++;
+        }
+    }
+
+    for (int more = status == 0; more;) {
+        pthread_mutex_lock(&q->lock);
+        for (;;) {
+            size_t slowest = SIZE_MAX;
+            for (size_t i = 0; i < started; ++i)
+                if (q->consumed[i] < slowest)
+                    slowest = q->consumed[i];
+            if (q->produced - slowest < EMIT_SLOTS)
+                break;
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        pthread_mutex_unlock(&q->lock);
+        EmitBatch* batch = &q->slots[q->produced % EMIT_SLOTS];
+        const double t1 = Now();
+        batch->n = NextBatch(&source, batch->insns);
+        decode_seconds += Now() - t1;
+        if (e->stats)
+            StatsCount(e->stats, batch->insns, batch->n);
+        more = batch->n > 0;
+        pthread_mutex_lock(&q->lock);
+        if (more)
+            q->produced++;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        q->done = 1;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    for (size_t i = 0; i < options->n_emits; ++i) {
+        Renderer* r = &renderers[i];
+        if (!r->file)
+            continue;
+        if (CloseRenderer(r) == EOF) {
+            if (r->error)
+                errno = r->error;
+            perror(r->path);
+            status = EOF;
+        }
+    }
+    if (e->stats) {
+        /* the renderers overlap the decode; they get whatever it left */
+        e->stats->decode_seconds += decode_seconds;
+        e->stats->format_seconds += Now() - t0 - decode_seconds;
+    }
+    if (q) {
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->cond);
+        free(q);
+    }
+    ArenaFree(&local);
+    if (status == EOF)
+        errno = 0;
+    return status;
+}
+
+/* smallest piece of a linear sweep worth handing to its own thread */
+#define MIN_CHUNK 0x1000
+
+typedef struct {
+    const Image* image;
+    size_t base;
+    /* the part of the sweep this thread classifies and, once begin has
+     * been moved onto a real instruction boundary, renders */
+    size_t begin;
+    size_t end;
+    /* attributes of every byte in the sweep, shared by all chunks */
+    uint8_t* attrs;
+    size_t start;
+    char* text;
+    size_t text_len;
+    int syntax;
+    /* this thread's --stats counters, or NULL */
+    Stats* stats;
+    double classify_seconds;
+    double render_seconds;
+    int error;
+} Chunk;
+
+static void* ClassifyChunk(void* arg) {
+    Chunk* c = arg;
+    const double start = Now();
+    ClassifyBytes(c->image->data + (c->begin - c->base), c->end - c->begin, c->attrs + (c->begin - c->start));
+    c->classify_seconds = Now() - start;
+    return NULL;
+}
+
+static int ChunkWrite(void* user, const char* text, size_t len) {
+    return fwrite(text, 1, len, user) == len ? 0 : EOF;
+}
+
+static void* RenderChunk(void* arg) {
+    Chunk* c = arg;
+    const double start = Now();
+    FILE* out = open_memstream(&c->text, &c->text_len);
+    if (!out) {
+        c->error = errno;
+        return NULL;
+    }
+    DisasmContext ctx = ImageContext(c->image, c->base);
+    ctx.syntax = c->syntax;
+    ctx.write = ChunkWrite;
+    ctx.user = out;
+    if (c->stats) {
+        /* the phased sweep needs an emitter of its own */
+        Emitter* e = malloc(sizeof(Emitter));
+        if (!e) {
+            c->error = errno;
+        } else {
+            EmitterInit(e, out, c->syntax);
+            e->stats = c->stats;
+            e->arena = NULL;
+            if (SweepPhased(e, &ctx, c->begin, c->end) == EOF)
+                c->error = errno;
+            free(e);
+        }
+    } else if (DisasmRange(&ctx, c->begin, c->end)) {
+        c->error = errno;
+    }
+    if (fclose(out) == EOF && !c->error)
+        c->error = errno;
+    c->render_seconds = Now() - start;
+    return NULL;
+}
+
+/* run fn over every chunk, one thread each, falling back to the calling
+ * thread when one cannot be started */
+static void RunChunks(Chunk* chunks, size_t n, void* (*fn)(void*)) {
+    pthread_t threads[n];
+    int started[n];
+    for (size_t i = 0; i < n; ++i) {
+        started[i] = pthread_create(&threads[i], NULL, fn, &chunks[i]) == 0;
+        if (!started[i])
+            fn(&chunks[i]);
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (started[i])
+            pthread_join(threads[i], NULL);
+}
+
+/* decode [start, end) on several threads. The chunks first classify
+ * their bytes in parallel; a serial resync pass then walks the
+ * instruction lengths from start and moves every chunk boundary onto
+ * the instruction that really straddles or starts it, after which each
+ * chunk renders exactly its own instructions and the texts are joined
+ * in order, so the listing is identical to SweepLinear() */
+static int SweepParallel(Emitter* e, const Image* image, const Options* options, size_t start, size_t end) {
+    size_t n = options->threads;
+    if (n > (end - start) / MIN_CHUNK)
+        n = (end - start) / MIN_CHUNK;
+    if (n < 2)
+        return SweepLinear(e, image, options->offset, start, end);
+
+    Chunk* chunks = calloc(n, sizeof(Chunk));
+    uint8_t* attrs = malloc(end - start);
+    if (!chunks || !attrs) {
+        free(chunks);
+        free(attrs);
+        return EOF;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        chunks[i].image = image;
+        chunks[i].base = options->offset;
+        chunks[i].begin = start + (end - start) * i / n;
+        chunks[i].end = start + (end - start) * (i + 1) / n;
+        chunks[i].attrs = attrs;
+        chunks[i].start = start;
+        chunks[i].syntax = e->syntax;
+    }
+    Stats* stats = NULL;
+    if (e->stats) {
+        stats = calloc(n, sizeof(Stats));
+        if (!stats) {
+            free(chunks);
+            free(attrs);
+            return EOF;
+        }
+        for (size_t i = 0; i < n; ++i)
+            chunks[i].stats = &stats[i];
+    }
+    RunChunks(chunks, n, ClassifyChunk);
+
+    const double resync_start = Now();
+    size_t address = start;
+    for (size_t i = 1; i < n; ++i) {
+        while (address < chunks[i].begin)
+            address += attrs[address - start] & ATTR_SIZE;
+        chunks[i].begin = chunks[i - 1].end = address;
+    }
+    const double resync = Now() - resync_start;
+
+    RunChunks(chunks, n, RenderChunk);
+    int status = EmitFlush(e);
+    for (size_t i = 0; i < n && status != EOF; ++i) {
+        Chunk* c = &chunks[i];
+        if (c->error) {
+            errno = c->error;
+            status = EOF;
+        } else if (fwrite(c->text, 1, c->text_len, e->file) != c->text_len) {
+            status = EOF;
+        }
+        e->flushed += c->text_len;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        Chunk* c = &chunks[i];
+        fprintf(stderr, "%s: thread %zu: %zu bytes, classified in %.3f ms, rendered in %.3f ms\n",
+                options->program_name, i, c->end - c->begin, c->classify_seconds * 1e3, c->render_seconds * 1e3);
+        free(c->text);
+    }
+    fprintf(stderr, "%s: resynchronised %zu chunks in %.3f ms\n", options->program_name, n, resync * 1e3);
+    if (stats) {
+        /* the threads ran side by side, so their times add up to cpu time */
+        for (size_t i = 0; i < n; ++i)
+            StatsMerge(e->stats, &stats[i]);
+        free(stats);
+    }
+    free(attrs);
+    free(chunks);
+    return status;
+}
+
+/* a pipe is decoded through a ring this big, however long it runs */
+#define STREAM_BUF_SIZE 0x1000
+
+/* linear sweep of a pipe or terminal: instructions are decoded as soon
+ * as their operand bytes have arrived and each read's worth of lines is
+ * flushed straight away; addresses keep counting past 0xffff */
+static int SweepStream(Emitter* e, int fd, const Options* options) {
+    uint8_t ring[STREAM_BUF_SIZE];
+    /* head is the next byte to decode, tail the next byte to read; both
+     * only ever grow and are reduced modulo the ring size on access */
+    size_t head = 0;
+    size_t tail = 0;
+    size_t skip = options->jump;
+    size_t address = options->offset + options->jump;
+    for (int eof = 0; !eof;) {
+        const size_t at = tail % STREAM_BUF_SIZE;
+        size_t room = STREAM_BUF_SIZE - (tail - head);
+        if (room > STREAM_BUF_SIZE - at)
+            room = STREAM_BUF_SIZE - at;
+        ssize_t n = read(fd, ring + at, room);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return EOF;
+        }
+        eof = n == 0;
+        tail += n;
+        if (skip) {
+            const size_t dropped = tail - head < skip ? tail - head : skip;
+            head += dropped;
+            skip -= dropped;
+        }
+        while (head < tail) {
+            const Op* op = &disasm_ops[ring[head % STREAM_BUF_SIZE]];
+            if (tail - head < op->size && !eof)
+                break;
+            /* past the end of the stream operands read as zero */
+            uint8_t bytes[3] = {0};
+            for (size_t i = 0; i < op->size && head + i < tail; ++i)
+                bytes[i] = ring[(head + i) % STREAM_BUF_SIZE];
+            Insn insn;
+            DecodeInsn(&insn, address, bytes);
+            if (EmitInsn(e, &insn) == EOF)
+                return EOF;
+            head += op->size;
+            address += op->size;
+        }
+        if (EmitFlush(e) == EOF || fflush(e->file) == EOF)
+            return EOF;
+    }
+    return 0;
+}
+
+/*
+ * --cache keeps the image, where every instruction of the last sweep
+ * started and its listing text. Rerunning on a patched image reuses the
+ * lines of every instruction whose bytes are unchanged and decodes again
+ * only from the first instruction covering a changed byte until the sweep
+ * lands back on an old instruction boundary past the change. Reused
+ * stretches are written straight from the mapped old cache, so a small
+ * patch costs about as much as copying the files.
+ *
+ * header, all little-endian:
+ *  0  magic "I80C"
+ *  4  version
+ *  6  syntax
+ *  8  offset, start and end of the sweep
+ * 20  image size
+ * 24  instruction count
+ * 28  text length
+ * 32  64-bit content hash of the image
+ * 40  byte order mark
+ * 44  reserved
+ * followed by the image padded to four bytes, count + 1 instruction
+ * addresses (the last one is where the sweep stopped) in host order, the
+ * length of every line and the text. A cache from a machine of the other
+ * byte order is simply rebuilt.
+ */
+#define CACHE_MAGIC "I80C"
+#define CACHE_VERSION 1
+#define CACHE_HEADER_SIZE 48
+#define CACHE_BOM 0x01020304
+
+typedef struct {
+    int syntax;
+    size_t offset;
+    size_t start;
+    size_t end;
+    uint64_t hash;
+    const uint8_t* image;
+    size_t image_size;
+    size_t count;
+    const uint32_t* addresses;
+    const uint8_t* lengths;
+    const char* text;
+    size_t text_len;
+} Cache;
+
+/* not cryptographic, only quick to tell one ROM from another */
+static uint64_t HashBytes(const uint8_t* data, size_t n) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    for (; i < n; ++i)
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    h ^= h >> 29;
+    return h * 0xc4ceb9fe1a85ec53ULL;
+}
+
+static size_t SumLengths(const uint8_t* lengths, size_t n) {
+    size_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += lengths[i];
+    return sum;
+}
+
+static int ParseCache(const uint8_t* p, size_t size, Cache* c) {
+    if (size < CACHE_HEADER_SIZE || memcmp(p, CACHE_MAGIC, 4) || GetLE16(p + 4) != CACHE_VERSION)
+        return -1;
+    c->syntax = GetLE16(p + 6);
+    c->offset = GetLE32(p + 8);
+    c->start = GetLE32(p + 12);
+    c->end = GetLE32(p + 16);
+    c->image_size = GetLE32(p + 20);
+    c->count = GetLE32(p + 24);
+    c->text_len = GetLE32(p + 28);
+    c->hash = GetLE32(p + 32) | (uint64_t)GetLE32(p + 36) << 32;
+    uint32_t bom;
+    memcpy(&bom, p + 40, 4);
+    const size_t padded = (c->image_size + 3) & ~(size_t)3;
+    if (bom != CACHE_BOM || size != CACHE_HEADER_SIZE + padded + (c->count + 1) * 4 + c->count + c->text_len)
+        return -1;
+    c->image = p + CACHE_HEADER_SIZE;
+    c->addresses = (const uint32_t*)(c->image + padded);
+    c->lengths = (const uint8_t*)(c->addresses + c->count + 1);
+    c->text = (const char*)c->lengths + c->count;
+    return SumLengths(c->lengths, c->count) == c->text_len ? 0 : -1;
+}
+
+/* first index at or after from where the two images differ */
+static size_t NextDiff(const uint8_t* a, const uint8_t* b, size_t from, size_t n) {
+    while (from + 64 <= n && !memcmp(a + from, b + from, 64))
+        from += 64;
+    while (from < n && a[from] == b[from])
+        ++from;
+    return from;
+}
+
+/* first old instruction at or after from that runs past limit */
+static size_t CacheRunEnd(const Cache* c, size_t from, size_t limit) {
+    size_t lo = from;
+    size_t hi = c->count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (c->addresses[mid + 1] <= limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* one section of the new cache, as stretches of either the old cache or
+ * bytes produced by this run */
+typedef struct {
+    struct {
+        const void* old;
+        size_t from;
+        size_t len;
+    }* pieces;
+    size_t n;
+    size_t cap;
+    uint8_t* fresh;
+    size_t fresh_len;
+    size_t fresh_cap;
+    size_t len;
+} CacheStream;
+
+static int StreamPiece(CacheStream* s, const void* old, size_t from, size_t len) {
+    s->len += len;
+    if (s->n && s->pieces[s->n - 1].old == old && s->pieces[s->n - 1].from + s->pieces[s->n - 1].len == from) {
+        s->pieces[s->n - 1].len += len;
+        return 0;
+    }
+    if (s->n == s->cap) {
+        const size_t cap = s->cap ? s->cap * 2 : 64;
+        void* grown = realloc(s->pieces, cap * sizeof(*s->pieces));
+        if (!grown)
+            return -1;
+        s->pieces = grown;
+        s->cap = cap;
+    }
+    s->pieces[s->n].old = old;
+    s->pieces[s->n].from = from;
+    s->pieces[s->n].len = len;
+    s->n++;
+    return 0;
+}
+
+/* room for up to len new bytes, kept once StreamCommit() says how many */
+static uint8_t* StreamReserve(CacheStream* s, size_t len) {
+    if (s->fresh_len + len > s->fresh_cap) {
+        const size_t cap = s->fresh_cap ? s->fresh_cap * 2 : 0x1000;
+        uint8_t* grown = realloc(s->fresh, cap);
+        if (!grown)
+            return NULL;
+        s->fresh = grown;
+        s->fresh_cap = cap;
+    }
+    return s->fresh + s->fresh_len;
+}
+
+static int StreamCommit(CacheStream* s, size_t len) {
+    s->fresh_len += len;
+    return StreamPiece(s, NULL, s->fresh_len - len, len);
+}
+
+static int StreamAppend(CacheStream* s, const void* bytes, size_t len) {
+    uint8_t* p = StreamReserve(s, len);
+    if (!p)
+        return -1;
+    memcpy(p, bytes, len);
+    return StreamCommit(s, len);
+}
+
+static int StreamWrite(FILE* f, const CacheStream* s) {
+    for (size_t i = 0; i < s->n; ++i) {
+        const uint8_t* bytes = s->pieces[i].old ? s->pieces[i].old : s->fresh;
+        if (fwrite(bytes + s->pieces[i].from, 1, s->pieces[i].len, f) != s->pieces[i].len)
+            return EOF;
+    }
+    return 0;
+}
 
-        case 0x80:
-            op.instruction = "ADD\tB";
-            break;
-        case 0x81:
-            op.instruction = "ADD\tC";
-            break;
-        case 0x82:
-            op.instruction = "ADD\tD";
-            break;
-        case 0x83:
-            op.instruction = "ADD\tE";
-            break;
-        case 0x84:
-            op.instruction = "ADD\tH";
-            break;
-        case 0x85:
-            op.instruction = "ADD\tL";
-            break;
-        case 0x86:
-            op.instruction = "ADD\tM";
-            break;
-        case 0x87:
-            op.instruction = "ADD\tA";
-            break;
-        case 0x88:
-            op.instruction = "ADC\tB";
-            break;
-        case 0x89:
-            op.instruction = "ADC\tC";
-            break;
-        case 0x8a:
-            op.instruction = "ADC\tD";
-            break;
-        case 0x8b:
-            op.instruction = "ADC\tE";
-            break;
-        case 0x8c:
-            op.instruction = "ADC\tH";
-            break;
-        case 0x8d:
-            op.instruction = "ADC\tL";
-            break;
-        case 0x8e:
-            op.instruction = "ADC\tM";
-            break;
-        case 0x8f:
-            op.instruction = "ADC\tA";
-            break;
+static void StreamFree(CacheStream* s) {
+    free(s->pieces);
+    free(s->fresh);
+}
 
-        case 0x90:
-            op.instruction = "SUB\tB";
-            break;
-        case 0x91:
-            op.instruction = "SUB\tC";
-            break;
-        case 0x92:
-            op.instruction = "SUB\tD";
-            break;
-        case 0x93:
-            op.instruction = "SUB\tE";
-            break;
-        case 0x94:
-            op.instruction = "SUB\tH";
-            break;
-        case 0x95:
-            op.instruction = "SUB\tL";
-            break;
-        case 0x96:
-            op.instruction = "SUB\tM";
-            break;
-        case 0x97:
-            op.instruction = "SUB\tA";
-            break;
-        case 0x98:
-            op.instruction = "SBB\tB";
-            break;
-        case 0x99:
-            op.instruction = "SBB\tC";
-            break;
-        case 0x9a:
-            op.instruction = "SBB\tD";
-            break;
-        case 0x9b:
-            op.instruction = "SBB\tE";
-            break;
-        case 0x9c:
-            op.instruction = "SBB\tH";
-            break;
-        case 0x9d:
-            op.instruction = "SBB\tL";
-            break;
-        case 0x9e:
-            op.instruction = "SBB\tM";
-            break;
-        case 0x9f:
-            op.instruction = "SBB\tA";
-            break;
+static int WriteCache(const char* path, const Cache* c, const CacheStream* addresses,
+                      const CacheStream* lengths, const CacheStream* text) {
+    uint8_t header[CACHE_HEADER_SIZE] = {0};
+    memcpy(header, CACHE_MAGIC, 4);
+    PutLE16(header + 4, CACHE_VERSION);
+    PutLE16(header + 6, c->syntax);
+    PutLE32(header + 8, c->offset);
+    PutLE32(header + 12, c->start);
+    PutLE32(header + 16, c->end);
+    PutLE32(header + 20, c->image_size);
+    PutLE32(header + 24, c->count);
+    PutLE32(header + 28, c->text_len);
+    PutLE32(header + 32, c->hash);
+    PutLE32(header + 36, c->hash >> 32);
+    const uint32_t bom = CACHE_BOM;
+    memcpy(header + 40, &bom, 4);
+    static const uint8_t zeros[3];
+    const size_t pad = -c->image_size & 3;
+    /* written aside and renamed over the old cache, which is still mapped */
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    FILE* f = fopen(tmp, "wb");
+    if (!f)
+        return -1;
+    int status = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+            && fwrite(c->image, 1, c->image_size, f) == c->image_size
+            && fwrite(zeros, 1, pad, f) == pad
+            && StreamWrite(f, addresses) == 0
+            && StreamWrite(f, lengths) == 0
+            && StreamWrite(f, text) == 0 ? 0 : -1;
+    if (fclose(f) == EOF)
+        status = -1;
+    if (status == 0 && rename(tmp, path) == 0)
+        return 0;
+    const int saved = errno;
+    unlink(tmp);
+    errno = saved;
+    return -1;
+}
 
-        case 0xa0:
-            op.instruction = "ANA\tB";
-            break;
-        case 0xa1:
-            op.instruction = "ANA\tC";
-            break;
-        case 0xa2:
-            op.instruction = "ANA\tD";
-            break;
-        case 0xa3:
-            op.instruction = "ANA\tE";
-            break;
-        case 0xa4:
-            op.instruction = "ANA\tH";
-            break;
-        case 0xa5:
-            op.instruction = "ANA\tL";
-            break;
-        case 0xa6:
-            op.instruction = "ANA\tM";
-            break;
-        case 0xa7:
-            op.instruction = "ANA\tA";
-            break;
-        case 0xa8:
-            op.instruction = "XRA\tB";
-            break;
-        case 0xa9:
-            op.instruction = "XRA\tC";
-            break;
-        case 0xaa:
-            op.instruction = "XRA\tD";
-            break;
-        case 0xab:
-            op.instruction = "XRA\tE";
-            break;
-        case 0xac:
-            op.instruction = "XRA\tH";
+/* linear text sweep that reuses whatever --cache holds for unchanged bytes */
+static int SweepCached(Emitter* e, const Image* image, const Options* options) {
+    const double t0 = Now();
+    const size_t base = options->offset;
+    const size_t start = base + options->jump;
+    const size_t end = base + image->size;
+    const uint64_t hash = HashBytes(image->data, image->size);
+
+    Image file = {0};
+    Cache old = {0};
+    int valid = LoadImage(options->cache, SIZE_MAX - 1, &file) == 0
+            && ParseCache(file.data, file.size, &old) == 0
+            && old.syntax == e->syntax && old.offset == base && old.start == start && old.end == end && old.image_size == image->size;
+    if (valid && old.hash == hash && !memcmp(old.image, image->data, image->size)) {
+        int status = EmitFlush(e) == EOF || fwrite(old.text, 1, old.text_len, e->file) != old.text_len ? EOF : 0;
+        e->flushed += old.text_len;
+        fprintf(stderr, "%s: cache hit, %zu instructions in %.3f ms\n",
+                options->program_name, old.count, (Now() - t0) * 1e3);
+        FreeImage(&file);
+        return status;
+    }
+    if (!valid)
+        old.count = 0;
+
+    CacheStream addresses = {0};
+    CacheStream lengths = {0};
+    CacheStream text = {0};
+    int status = EOF;
+    size_t reused = 0;
+    size_t decoded = 0;
+    /* old instruction the sweep is at or before, and where its line starts */
+    size_t k = 0;
+    size_t line = 0;
+    /* next changed address at or after the sweep, if there is anything to reuse */
+    size_t diff = old.count ? base + NextDiff(old.image, image->data, start - base, image->size) : SIZE_MAX;
+    size_t address = start;
+    while (address < end) {
+        while (k < old.count && old.addresses[k] < address)
+            line += old.lengths[k++];
+        if (k < old.count && old.addresses[k] == address && old.addresses[k + 1] <= diff) {
+            /* in step with the old sweep and clear of the change: reuse the run */
+            const size_t j = CacheRunEnd(&old, k, diff);
+            const size_t run = SumLengths(old.lengths + k, j - k);
+            if (StreamPiece(&addresses, old.addresses, k * 4, (j - k) * 4) < 0
+                || StreamPiece(&lengths, old.lengths, k, j - k) < 0
+                || StreamPiece(&text, old.text, line, run) < 0)
+                goto done;
+            reused += j - k;
+            line += run;
+            k = j;
+            address = old.addresses[j];
+            continue;
+        }
+        const uint8_t* bytes = image->data + (address - base);
+        uint8_t tail[3] = {0};
+        if (address + 3 > end) {
+            memcpy(tail, bytes, end - address < 3 ? end - address : 3);
+            bytes = tail;
+        }
+        Insn insn;
+        DecodeInsn(&insn, address, bytes);
+        char* out = (char*)StreamReserve(&text, DISASM_LINE_MAX);
+        if (!out)
+            goto done;
+        const uint8_t len = e->format(out, &insn);
+        const uint32_t at = address;
+        if (StreamCommit(&text, len) < 0 || StreamAppend(&addresses, &at, 4) < 0 || StreamAppend(&lengths, &len, 1) < 0)
+            goto done;
+        ++decoded;
+        address += insn.size;
+        if (address > diff)
+            diff = base + NextDiff(old.image, image->data, address - base, image->size);
+    }
+    const uint32_t stop = address;
+    if (StreamAppend(&addresses, &stop, 4) < 0)
+        goto done;
+    const double t1 = Now();
+
+    status = EmitFlush(e) == EOF || StreamWrite(e->file, &text) == EOF ? EOF : 0;
+    e->flushed += text.len;
+    const Cache next = {
+            .syntax = e->syntax, .offset = base, .start = start, .end = end, .hash = hash,
+            .image = image->data, .image_size = image->size,
+            .count = reused + decoded, .text_len = text.len,
+    };
+    if (WriteCache(options->cache, &next, &addresses, &lengths, &text) < 0)
+        fprintf(stderr, "%s: cannot update cache %s: %s\n", options->program_name, options->cache, strerror(errno));
+    fprintf(stderr, "%s: cache %s, reused %zu and decoded %zu instructions in %.3f ms\n",
+            options->program_name, valid ? "patched" : "rebuilt", reused, decoded, (t1 - t0) * 1e3);
+done:
+    StreamFree(&addresses);
+    StreamFree(&lengths);
+    StreamFree(&text);
+    FreeImage(&file);
+    return status;
+}
+
+/*
+ * --cache-dir: finished listings shared by every batch run pointed at the
+ * same directory. An entry is named by a 128-bit hash of the image and of
+ * everything else its listing depends on, so the same BIOS in a hundred
+ * dumps is decoded once and copied out from then on. Entries are written
+ * aside and renamed into place, so another process sees a whole entry or
+ * none. A hit touches the entry, and a run that takes the directory past
+ * --cache-max removes the least recently used entries while it holds an
+ * flock() on DIR/.lock.
+ *
+ * entry header, all little-endian:
+ *  0  magic "I80L"
+ *  4  version
+ *  6  flags: ENTRY_PACKED when the listing is LZ77 packed
+ *  8  listing length
+ * 12  low 32 bits of the listing's HashBytes(), checked on every hit
+ * 16  the 128-bit key the entry is named by
+ * followed by the listing, packed or as it is
+ */
+#define ENTRY_MAGIC "I80L"
+#define ENTRY_VERSION 1
+#define ENTRY_HEADER_SIZE 32
+#define ENTRY_PACKED 1
+#define ENTRY_NAME_LEN 32
+#define CACHE_MAX_DEFAULT ((size_t)256 << 20)
+/* a full directory is trimmed to this, so it is not rescanned on every store */
+#define CACHE_TRIM(max) ((max) / 4 * 3)
+/* temporary files older than this were left by a run that died */
+#define CACHE_STALE_SECONDS 3600
+
+typedef struct {
+    const char* dir;
+    size_t max;
+    /* the options and the formatter, hashed into every key */
+    uint64_t salt;
+    /* bytes in the directory as far as this run knows */
+    size_t used;
+    size_t hits;
+    size_t stored;
+    pthread_mutex_t lock;
+} ListingCache;
+
+typedef struct {
+    uint64_t h[2];
+} EntryKey;
+
+static inline uint64_t HashMix(uint64_t h, uint64_t v) {
+    h = (h ^ v) * 0xff51afd7ed558ccdULL;
+    return h ^ h >> 32;
+}
+
+/* everything besides the image a batch listing depends on: the options,
+ * the --symbols names and what the formatter makes of every opcode, so a
+ * build that lists anything differently does not find the old entries */
+static uint64_t CacheSalt(const Options* o) {
+    uint64_t h = HashMix(ENTRY_VERSION, o->offset);
+    h = HashMix(h, o->jump);
+    h = HashMix(h, o->recursive | o->labels << 1 | o->data << 2 | o->reassemble << 3 | o->verify << 4);
+    h = HashMix(h, (uint64_t)o->format << 8 | o->syntax);
+    h = HashMix(h, o->count);
+    h = HashMix(h, o->n_entries);
+    for (size_t i = 0; i < o->n_entries; ++i)
+        h = HashMix(h, o->entries[i]);
+    h = HashMix(h, o->n_ranges);
+    for (size_t i = 0; i < o->n_ranges; ++i)
+        h = HashMix(HashMix(h, o->ranges[i][0]), o->ranges[i][1]);
+    const SymbolTable* t = o->symbols;
+    for (size_t i = 0; t && t->keys && i <= t->mask; ++i) {
+        if (t->keys[i])
+            h = HashMix(HashMix(h, t->keys[i]), HashBytes((const uint8_t*)t->names[i], strlen(t->names[i])));
+    }
+    char line[DISASM_LINE_MAX];
+    for (int op = 0; op < 256; ++op) {
+        const uint8_t bytes[3] = {op, 0x34, 0x12};
+        Insn insn;
+        DecodeInsn(&insn, 0x100, bytes);
+        h = HashMix(h, HashBytes((const uint8_t*)line, disasm_formatters[o->syntax](line, &insn)));
+    }
+    const uint8_t data[2] = {0x12, 0x34};
+    return HashMix(h, HashBytes((const uint8_t*)line, FormatDataSyntax(line, o->syntax, 0x100, data, 2)));
+}
+
+/* two independent 64-bit lanes over the image in a single pass */
+static EntryKey KeyImage(const ListingCache* c, const uint8_t* data, size_t n) {
+    uint64_t a = c->salt ^ n;
+    uint64_t b = (c->salt ^ 0x9e3779b97f4a7c15ULL) * 0xc4ceb9fe1a85ec53ULL + n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        a = (a ^ w) * 0xff51afd7ed558ccdULL;
+        a ^= a >> 32;
+        b = (b ^ (w << 29 | w >> 35)) * 0xc4ceb9fe1a85ec53ULL;
+        b ^= b >> 29;
+    }
+    for (; i < n; ++i) {
+        a = (a ^ data[i]) * 0x100000001b3ULL;
+        b = (b ^ data[i]) * 0x9e3779b97f4a7c15ULL;
+    }
+    return (EntryKey){{HashMix(a, b), HashMix(b, a >> 7)}};
+}
+
+static int EntryPath(const ListingCache* c, const EntryKey* key, char* path, size_t size) {
+    if (snprintf(path, size, "%s/%016" PRIx64 "%016" PRIx64, c->dir, key->h[0], key->h[1]) >= (int)size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * entries are packed LZ77 sequences: a token byte with the number of
+ * literals in the high nibble and the match length less LZ_MIN_MATCH in
+ * the low one, a nibble of 15 going on in bytes of 255 until a smaller
+ * one; then the literals and the 16-bit distance back to the match. The
+ * last sequence is literals only. Listings repeat their mnemonics and
+ * address digits on every line, which is what the matches find
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_WINDOW 0xffff
+#define LZ_SLACK 16
+
+static inline size_t PackBound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+static inline uint8_t* PutLength(uint8_t* p, size_t n) {
+    for (; n >= 255; n -= 255)
+        *p++ = 255;
+    *p++ = n;
+    return p;
+}
+
+/* a match of 0 ends the packed text */
+static uint8_t* PutSequence(uint8_t* p, const uint8_t* literals, size_t n, size_t distance, size_t match) {
+    uint8_t* token = p++;
+    *token = (n < 15 ? n : 15) << 4;
+    if (n >= 15)
+        p = PutLength(p, n - 15);
+    memcpy(p, literals, n);
+    p += n;
+    if (!match)
+        return p;
+    p = PutLE16(p, distance);
+    match -= LZ_MIN_MATCH;
+    *token |= match < 15 ? match : 15;
+    if (match >= 15)
+        p = PutLength(p, match - 15);
+    return p;
+}
+
+/* pack n bytes into out, which has room for PackBound(n) */
+static size_t PackListing(const uint8_t* in, size_t n, uint8_t* out) {
+    uint32_t table[1 << LZ_HASH_BITS] = {0};
+    uint8_t* p = out;
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t w, v;
+        memcpy(&w, in + i, 4);
+        const uint32_t h = w * 2654435761u >> (32 - LZ_HASH_BITS);
+        size_t from = table[h];
+        table[h] = i;
+        memcpy(&v, in + from, 4);
+        if (from >= i || i - from > LZ_WINDOW || v != w) {
+            ++i;
+            continue;
+        }
+        size_t len = LZ_MIN_MATCH;
+        while (i + len + 8 <= n) {
+            uint64_t x, y;
+            memcpy(&x, in + from + len, 8);
+            memcpy(&y, in + i + len, 8);
+            if (x != y) {
+                len += __builtin_ctzll(x ^ y) / 8;
+                goto matched;
+            }
+            len += 8;
+        }
+        while (i + len < n && in[from + len] == in[i + len])
+            ++len;
+    matched:
+        while (i > anchor && from > 0 && in[i - 1] == in[from - 1]) {
+            --i;
+            --from;
+            ++len;
+        }
+        p = PutSequence(p, in + anchor, i - anchor, i - from, len);
+        i += len;
+        anchor = i;
+    }
+    return PutSequence(p, in + anchor, n - anchor, 0, 0) - out;
+}
+
+static inline const uint8_t* GetLength(const uint8_t* p, const uint8_t* end, size_t* n) {
+    uint8_t byte;
+    do {
+        if (p == end)
+            return NULL;
+        byte = *p++;
+        *n += byte;
+    } while (byte == 255);
+    return p;
+}
+
+/* unpack exactly size bytes into out, which has LZ_SLACK bytes of room
+ * past them for copies made 16 bytes at a time; -1 for a damaged entry */
+static int UnpackListing(const uint8_t* in, size_t n, uint8_t* out, size_t size) {
+    const uint8_t* const end = in + n;
+    size_t o = 0;
+    while (in < end) {
+        const uint8_t token = *in++;
+        size_t len = token >> 4;
+        if (len == 15 && !(in = GetLength(in, end, &len)))
+            return -1;
+        if ((size_t)(end - in) < len || size - o < len)
+            return -1;
+        if (len <= 16 && end - in >= 16)
+            memcpy(out + o, in, 16);
+        else
+            memcpy(out + o, in, len);
+        in += len;
+        o += len;
+        if (in == end)
+            break;
+        if (end - in < 2)
+            return -1;
+        const size_t distance = GetLE16(in);
+        in += 2;
+        size_t match = token & 15;
+        if (match == 15 && !(in = GetLength(in, end, &match)))
+            return -1;
+        match += LZ_MIN_MATCH;
+        if (!distance || distance > o || size - o < match)
+            return -1;
+        uint8_t* to = out + o;
+        const uint8_t* from = to - distance;
+        if (distance >= 16) {
+            for (size_t k = 0; k < match; k += 16)
+                memcpy(to + k, from + k, 16);
+        } else if (distance >= 8) {
+            for (size_t k = 0; k < match; k += 8)
+                memcpy(to + k, from + k, 8);
+        } else {
+            for (size_t k = 0; k < match; ++k)
+                to[k] = from[k];
+        }
+        o += match;
+    }
+    return o == size ? 0 : -1;
+}
+
+/* the listing stored under key, into a malloc()'d *text; -1 on a miss */
+static int CacheLookup(ListingCache* c, const EntryKey* key, char** text, size_t* len) {
+    char path[PATH_MAX];
+    Image entry;
+    if (EntryPath(c, key, path, sizeof(path)) < 0 || LoadImage(path, SIZE_MAX - 1, &entry) < 0)
+        return -1;
+    const uint8_t* p = entry.data;
+    int status = -1;
+    if (entry.size >= ENTRY_HEADER_SIZE && !memcmp(p, ENTRY_MAGIC, 4) && GetLE16(p + 4) == ENTRY_VERSION
+        && (GetLE32(p + 16) | (uint64_t)GetLE32(p + 20) << 32) == key->h[0]
+        && (GetLE32(p + 24) | (uint64_t)GetLE32(p + 28) << 32) == key->h[1]) {
+        const size_t size = GetLE32(p + 8);
+        const uint8_t* body = p + ENTRY_HEADER_SIZE;
+        const size_t n = entry.size - ENTRY_HEADER_SIZE;
+        const int packed = GetLE16(p + 6) & ENTRY_PACKED;
+        char* out = malloc(size + LZ_SLACK);
+        const int whole = out && (packed ? UnpackListing(body, n, (uint8_t*)out, size) == 0 : n == size);
+        if (whole && !packed)
+            memcpy(out, body, size);
+        /* a damaged entry is a miss, and the listing is stored over it */
+        if (whole && (uint32_t)HashBytes((const uint8_t*)out, size) == GetLE32(p + 12)) {
+            *text = out;
+            *len = size;
+            status = 0;
+        } else {
+            free(out);
+        }
+    }
+    FreeImage(&entry);
+    if (status == 0) {
+        /* eviction goes by when an entry was last used */
+        utimensat(AT_FDCWD, path, NULL, 0);
+        pthread_mutex_lock(&c->lock);
+        c->hits++;
+        pthread_mutex_unlock(&c->lock);
+    }
+    return status;
+}
+
+typedef struct {
+    struct timespec used;
+    size_t size;
+    char name[ENTRY_NAME_LEN + 1];
+} CacheFile;
+
+static int CompareUse(const void* a, const void* b) {
+    const struct timespec* x = &((const CacheFile*)a)->used;
+    const struct timespec* y = &((const CacheFile*)b)->used;
+    return x->tv_sec != y->tv_sec ? (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec)
+                                  : (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/* learn what the directory holds, under its lock, and remove the least
+ * recently used entries when that is more than --cache-max */
+static int CacheTrim(ListingCache* c) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/.lock", c->dir) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    const int lock = open(path, O_RDWR | O_CREAT, 0666);
+    if (lock < 0)
+        return -1;
+    DIR* dir = flock(lock, LOCK_EX) == 0 ? opendir(c->dir) : NULL;
+    if (!dir) {
+        const int saved = errno;
+        close(lock);
+        errno = saved;
+        return -1;
+    }
+    CacheFile* files = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+    size_t total = 0;
+    const time_t now = time(NULL);
+    struct dirent* d;
+    while ((d = readdir(dir))) {
+        const int tmp = !strncmp(d->d_name, ".tmp.", 5);
+        struct stat st;
+        if ((!tmp && (strspn(d->d_name, "0123456789abcdef") != ENTRY_NAME_LEN || d->d_name[ENTRY_NAME_LEN]))
+            || fstatat(dirfd(dir), d->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (tmp) {
+            if (now - st.st_mtime > CACHE_STALE_SECONDS)
+                unlinkat(dirfd(dir), d->d_name, 0);
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            CacheFile* grown = realloc(files, cap * sizeof(CacheFile));
+            if (!grown)
+                break;
+            files = grown;
+        }
+        files[n].used = st.st_mtim;
+        files[n].size = st.st_size;
+        memcpy(files[n].name, d->d_name, ENTRY_NAME_LEN + 1);
+        total += st.st_size;
+        n++;
+    }
+    if (total > c->max) {
+        qsort(files, n, sizeof(CacheFile), CompareUse);
+        for (size_t i = 0; i < n && total > CACHE_TRIM(c->max); ++i) {
+            if (unlinkat(dirfd(dir), files[i].name, 0) == 0)
+                total -= files[i].size;
+        }
+    }
+    closedir(dir);
+    free(files);
+    pthread_mutex_lock(&c->lock);
+    c->used = total;
+    pthread_mutex_unlock(&c->lock);
+    /* closing the descriptor lets the next run in */
+    close(lock);
+    return 0;
+}
+
+/* store a listing under key; packed when that makes it smaller */
+static int CacheStore(ListingCache* c, const EntryKey* key, const char* text, size_t len) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    if (EntryPath(c, key, path, sizeof(path)) < 0)
+        return -1;
+    if (snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", c->dir) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    uint8_t* entry = malloc(ENTRY_HEADER_SIZE + PackBound(len));
+    if (!entry)
+        return -1;
+    memset(entry, 0, ENTRY_HEADER_SIZE);
+    memcpy(entry, ENTRY_MAGIC, 4);
+    PutLE16(entry + 4, ENTRY_VERSION);
+    PutLE32(entry + 8, len);
+    PutLE32(entry + 12, HashBytes((const uint8_t*)text, len));
+    PutLE32(entry + 16, key->h[0]);
+    PutLE32(entry + 20, key->h[0] >> 32);
+    PutLE32(entry + 24, key->h[1]);
+    PutLE32(entry + 28, key->h[1] >> 32);
+    size_t size = PackListing((const uint8_t*)text, len, entry + ENTRY_HEADER_SIZE);
+    if (size < len) {
+        PutLE16(entry + 6, ENTRY_PACKED);
+    } else {
+        memcpy(entry + ENTRY_HEADER_SIZE, text, len);
+        size = len;
+    }
+    size += ENTRY_HEADER_SIZE;
+    /* a damaged entry or one another run stored meanwhile is replaced */
+    struct stat st;
+    const size_t replaced = stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+    const int fd = mkstemp(tmp);
+    int status = fd < 0 ? -1 : write(fd, entry, size) == (ssize_t)size ? 0 : -1;
+    if (fd >= 0 && close(fd) < 0)
+        status = -1;
+    if (fd >= 0 && (status < 0 || rename(tmp, path) < 0)) {
+        const int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        status = -1;
+    }
+    free(entry);
+    if (status < 0)
+        return -1;
+    pthread_mutex_lock(&c->lock);
+    c->stored++;
+    c->used = c->used + size > replaced ? c->used + size - replaced : 0;
+    const int full = c->used > c->max;
+    pthread_mutex_unlock(&c->lock);
+    return full ? CacheTrim(c) : 0;
+}
+
+/*
+ * banked images: the file is cut into banks of bank_size bytes and each
+ * one is decoded as if mapped at its own cpu base address, so dumps far
+ * bigger than the cpu memory can be listed. Nothing is copied; every bank
+ * is a context over its own slice of the mapped file
+ */
+#define BANK_SIZE 0x4000
+#define MAX_BANKS 0x10000
+/* pages[] values that are not a bank */
+#define BANK_NONE UINT32_MAX
+#define BANK_SHARED (UINT32_MAX - 1)
+
+typedef struct {
+    size_t size;
+    /* file offset -> cpu base pairs from --bank and --bank-map */
+    size_t (*map)[2];
+    size_t n_map;
+    /* where banks without an entry go */
+    size_t base;
+} BankConfig;
+
+typedef struct {
+    const uint8_t* data;
+    size_t offset;
+    size_t size;
+    size_t base;
+} Bank;
+
+typedef struct {
+    Bank* banks;
+    size_t n;
+    /* for every 256-byte cpu page, the only bank mapped there, so a
+     * reference from another bank can still be labelled */
+    uint32_t pages[MEM_SIZE >> 8];
+} Banks;
+
+static int BankConfigAdd(BankConfig* config, size_t offset, size_t base) {
+    size_t (*grown)[2] = realloc(config->map, (config->n_map + 1) * sizeof(*grown));
+    if (!grown)
+        return -1;
+    config->map = grown;
+    config->map[config->n_map][0] = offset;
+    config->map[config->n_map][1] = base;
+    ++config->n_map;
+    return 0;
+}
+
+/* "OFFSET=BASE" or "OFFSET:BASE", as --bank and each bank map line take it */
+static int ParseBank(char* text, size_t* offset, size_t* base) {
+    char* sep = text + strcspn(text, "=: \t");
+    if (!*sep)
+        return -1;
+    *sep++ = '\0';
+    sep += strspn(sep, "=: \t");
+    uint32_t address;
+    if (ParseOffset(text, offset) < 0 || ParseAddress(sep, &address) < 0)
+        return -1;
+    *base = address;
+    return 0;
+}
+
+static int LoadBankMap(const char* path, BankConfig* config) {
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return -1;
+    char line[256];
+    size_t line_number = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), f)) {
+        ++line_number;
+        line[strcspn(line, ";#\r\n")] = '\0';
+        char* text = line + strspn(line, " \t");
+        size_t offset, base;
+        if (!*text)
+            continue;
+        if (ParseBank(text, &offset, &base) < 0)
+            fprintf(stderr, "%s:%zu: expected a file offset and a cpu address\n", path, line_number);
+        else
+            status = BankConfigAdd(config, offset, base);
+    }
+    if (ferror(f))
+        status = -1;
+    fclose(f);
+    return status;
+}
+
+/* cut data into banks; returns -1 with a message when the map does not fit */
+static int BuildBanks(const char* program_name, const uint8_t* data, size_t size, const BankConfig* config,
+                      Banks* b) {
+    b->n = (size + config->size - 1) / config->size;
+    if (b->n > MAX_BANKS) {
+        fprintf(stderr, "%s: %zu banks are more than %d\n", program_name, b->n, MAX_BANKS);
+        return -1;
+    }
+    b->banks = calloc(b->n ? b->n : 1, sizeof(Bank));
+    if (!b->banks) {
+        perror(program_name);
+        return -1;
+    }
+    for (size_t i = 0; i < b->n; ++i) {
+        b->banks[i].offset = i * config->size;
+        b->banks[i].data = data + i * config->size;
+        b->banks[i].size = size - i * config->size < config->size ? size - i * config->size : config->size;
+        b->banks[i].base = config->base;
+    }
+    for (size_t i = 0; i < config->n_map; ++i) {
+        const size_t offset = config->map[i][0];
+        if (offset % config->size) {
+            fprintf(stderr, "%s: bank offset %#zx is not a multiple of the bank size\n", program_name, offset);
+            return -1;
+        }
+        if (offset / config->size < b->n)
+            b->banks[offset / config->size].base = config->map[i][1];
+    }
+    for (size_t page = 0; page < MEM_SIZE >> 8; ++page)
+        b->pages[page] = BANK_NONE;
+    for (size_t i = 0; i < b->n; ++i) {
+        const Bank* bank = &b->banks[i];
+        if (bank->base + bank->size > MEM_SIZE) {
+            fprintf(stderr, "%s: bank %zu at %04zx does not fit the cpu memory\n", program_name, i, bank->base);
+            return -1;
+        }
+        for (size_t page = bank->base >> 8; page <= (bank->base + bank->size - 1) >> 8; ++page)
+            b->pages[page] = b->pages[page] == BANK_NONE ? i : BANK_SHARED;
+    }
+    return 0;
+}
+
+/* the bank an address seen from bank from refers to: its own, or the one
+ * bank mapped there; SIZE_MAX when that is anyone's guess */
+static inline size_t ResolveBank(const Banks* b, size_t from, size_t address) {
+    if (address - b->banks[from].base < b->banks[from].size)
+        return from;
+    const uint32_t owner = b->pages[address >> 8];
+    if (owner < b->n && address - b->banks[owner].base < b->banks[owner].size)
+        return owner;
+    return SIZE_MAX;
+}
+
+static inline DisasmContext BankContext(const Bank* bank, int syntax) {
+    return (DisasmContext){.data = bank->data, .size = bank->size, .base = bank->base, .syntax = syntax};
+}
+
+static int EmitBankHeader(Emitter* e, size_t index, const Bank* bank) {
+    char header[64];
+    int n = snprintf(header, sizeof(header), "; bank %zu at %04zx, file offset %zx\n", index, bank->base, bank->offset);
+    return EmitText(e, header, n);
+}
+
+/* user symbols name an address only where a single bank is mapped, bank
+ * labels are L<bank>_<address> */
+static const char* BankLabelName(const Banks* b, const SymbolTable* user, const SymbolTable* labels, size_t bank,
+                                 uint32_t address, char* scratch) {
+    const char* name = NULL;
+    if (b->pages[address >> 8] == bank && SymbolFind(user, address, &name) && name)
+        return name;
+    if (!SymbolFind(labels, bank << 16 | address, &name))
+        return NULL;
+    snprintf(scratch, 16, "L%02zx_%04x", bank, address);
+    return scratch;
+}
+
+#define BANK_BLOCK 0x400
+
+/* every bank with labels: one pass finds where instructions start and
+ * what they reference, the second renders */
+static int EmitBanksLabeled(Emitter* e, const Banks* b, size_t file_size, const SymbolTable* user) {
+    Insn insns[BANK_BLOCK];
+    Arena local = {0};
+    Arena* arena = e->arena ? e->arena : &local;
+    /* a bank holds at most a third of its size in word operands */
+    size_t targets_cap = 0;
+    for (size_t i = 0; i < b->n; ++i)
+        targets_cap += b->banks[i].size / 3 + 1;
+    uint64_t* starts = NULL;
+    uint32_t* targets = NULL;
+    if (ArenaReserve(arena, (file_size / 64 + 1) * sizeof(uint64_t) + targets_cap * sizeof(uint32_t) + 32) == 0) {
+        starts = ArenaCalloc(arena, (file_size / 64 + 1) * sizeof(uint64_t));
+        targets = ArenaAlloc(arena, targets_cap * sizeof(uint32_t));
+    }
+    size_t n_targets = 0;
+    SymbolTable labels = {0};
+    int status = starts && targets ? 0 : EOF;
+    for (size_t i = 0; i < b->n && status == 0; ++i) {
+        const Bank* bank = &b->banks[i];
+        const DisasmContext ctx = BankContext(bank, e->syntax);
+        for (size_t address = bank->base; address < bank->base + bank->size && status == 0;) {
+            const size_t n = DecodeRange(&ctx, address, bank->base + bank->size, insns, BANK_BLOCK, &address);
+            for (size_t k = 0; k < n; ++k) {
+                const size_t at = bank->offset + (insns[k].address - bank->base);
+                starts[at / 64] |= 1ull << (at % 64);
+                if (insns[k].size < 3)
+                    continue;
+                const size_t target = ResolveBank(b, i, insns[k].operand);
+                if (target == SIZE_MAX)
+                    continue;
+                targets[n_targets++] = target << 16 | insns[k].operand;
+            }
+        }
+    }
+    if (status == 0)
+        status = SymbolInit(&labels, n_targets, arena);
+    /* only targets something starts at get a label, or it would never be printed */
+    for (size_t k = 0; k < n_targets && status == 0; ++k) {
+        const Bank* bank = &b->banks[targets[k] >> 16];
+        const uint32_t address = targets[k] & 0xffff;
+        const size_t at = bank->offset + (address - bank->base);
+        const char* name;
+        if (starts[at / 64] >> (at % 64) & 1
+            && !(b->pages[address >> 8] == targets[k] >> 16 && SymbolFind(user, address, &name) && name))
+            status = SymbolInsert(&labels, targets[k], NULL);
+    }
+
+    char scratch[16];
+    for (size_t i = 0; i < b->n && status == 0; ++i) {
+        const Bank* bank = &b->banks[i];
+        const DisasmContext ctx = BankContext(bank, e->syntax);
+        status = EmitBankHeader(e, i, bank);
+        for (size_t address = bank->base; address < bank->base + bank->size && status == 0;) {
+            const double t0 = Now();
+            const size_t n = DecodeRange(&ctx, address, bank->base + bank->size, insns, BANK_BLOCK, &address);
+            if (e->stats) {
+                StatsCount(e->stats, insns, n);
+                e->stats->decode_seconds += Now() - t0;
+            }
+            const double t1 = Now();
+            for (size_t k = 0; k < n && status == 0; ++k) {
+                const Insn* insn = &insns[k];
+                const char* label = BankLabelName(b, user, &labels, i, insn->address, scratch);
+                if (label && (EmitText(e, label, strlen(label)) == EOF || EmitText(e, ":\n", 2) == EOF)) {
+                    status = EOF;
+                    break;
+                }
+                if (disasm_syntax[e->syntax][insn->opcode].operand == SYNTAX_WORD) {
+                    const size_t target = ResolveBank(b, i, insn->operand);
+                    const char* name = target == SIZE_MAX ? NULL
+                            : BankLabelName(b, user, &labels, target, insn->operand, scratch);
+                    status = EmitNamed(e, insn, name);
+                } else {
+                    status = EmitInsn(e, insn);
+                }
+            }
+            if (e->stats)
+                e->stats->format_seconds += Now() - t1;
+        }
+    }
+    ArenaFree(&local);
+    return status == EOF ? EOF : EmitFlush(e);
+}
+
+/* the header and the listing of one bank, or with --range only the parts
+ * of the ranges it maps; a bank outside all of them is left out. Only the
+ * pages around those parts are ever read from the mapped file */
+static int SweepBank(Emitter* e, const Options* options, size_t index, const Bank* bank) {
+    DisasmContext ctx = BankContext(bank, e->syntax);
+    ctx.write = EmitterWrite;
+    ctx.user = e;
+    if (!options->n_ranges) {
+        if (EmitBankHeader(e, index, bank) == EOF || EmitFlush(e) == EOF)
+            return EOF;
+        return (e->stats ? SweepPhased(e, &ctx, ctx.base, ctx.base + ctx.size) == EOF
+                         : DisasmRange(&ctx, ctx.base, ctx.base + ctx.size) != 0) ? EOF : 0;
+    }
+    int listed = 0;
+    for (size_t i = 0; i < options->n_ranges; ++i) {
+        size_t start, end;
+        if ((options->range_banks[i] != ANY_BANK && options->range_banks[i] != index)
+            || !ResolveRange(&ctx, options, i, &start, &end))
+            continue;
+        if (!listed++ && (EmitBankHeader(e, index, bank) == EOF || EmitFlush(e) == EOF))
+            return EOF;
+        if (e->stats ? SweepPhased(e, &ctx, start, end) == EOF : DisasmRange(&ctx, start, end) != 0)
+            return EOF;
+    }
+    return 0;
+}
+
+/* list a banked image that is already in memory */
+static int SweepBanks(Emitter* e, const Image* image, const Options* options, const BankConfig* config) {
+    Banks* b = calloc(1, sizeof(Banks));
+    if (!b || BuildBanks(options->program_name, image->data, image->size, config, b) < 0) {
+        if (b)
+            free(b->banks);
+        free(b);
+        errno = 0;
+        return EOF;
+    }
+    int status = 0;
+    if (options->labels) {
+        status = EmitBanksLabeled(e, b, image->size, options->symbols);
+    } else {
+        for (size_t i = 0; i < b->n && status == 0; ++i)
+            status = SweepBank(e, options, i, &b->banks[i]);
+    }
+    free(b->banks);
+    free(b);
+    return status;
+}
+
+/* a pipe of banks is read one bank at a time into a single buffer */
+static int SweepBankStream(Emitter* e, int fd, const Options* options, const BankConfig* config) {
+    uint8_t* buf = malloc(config->size);
+    if (!buf)
+        return EOF;
+    int status = 0;
+    for (size_t index = 0, eof = 0; status == 0 && !eof; ++index) {
+        Bank bank = {buf, index * config->size, 0, config->base};
+        const double read_start = Now();
+        while (bank.size < config->size) {
+            ssize_t n = read(fd, buf + bank.size, config->size - bank.size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                status = n < 0 ? EOF : 0;
+                eof = 1;
+                break;
+            }
+            bank.size += n;
+        }
+        if (e->stats) {
+            e->stats->read_seconds += Now() - read_start;
+            e->stats->bytes_read += bank.size;
+        }
+        if (status || !bank.size)
             break;
-        case 0xad:
-            op.instruction = "XRA\tL";
+        for (size_t i = 0; i < config->n_map; ++i)
+            if (config->map[i][0] == bank.offset)
+                bank.base = config->map[i][1];
+        if (bank.base + bank.size > MEM_SIZE) {
+            fprintf(stderr, "%s: bank %zu at %04zx does not fit the cpu memory\n",
+                    options->program_name, index, bank.base);
+            errno = 0;
+            status = EOF;
             break;
-        case 0xae:
-            op.instruction = "XRA\tM";
+        }
+        status = SweepBank(e, options, index, &bank);
+    }
+    free(buf);
+    return status;
+}
+
+/* listings made from the decoded records of the whole image at once */
+static inline int DecodedListing(const Options* options) {
+    return Marked(options) || options->labels || options->format != FORMAT_TEXT || options->xref || options->cfg_dot
+           || options->cfg_bin || options->reassemble || options->verify;
+}
+
+/* true when DisassembleImage() would end in the plain linear sweep, the
+ * only listing that can be written while the bytes are still arriving */
+static inline int PlainSweep(const Options* options) {
+    return !options->n_emits && !DecodedListing(options) && !options->n_ranges && !options->cache && !options->data;
+}
+
+static int DisassembleImage(Emitter* e, const Image* image, const Options* options) {
+    if (options->n_emits)
+        return EmitFormats(e, image, options);
+    if (DecodedListing(options))
+        return DecodeAndWrite(e, image, options);
+    if (options->n_ranges)
+        return SweepRanges(e, image, options);
+    if (options->cache)
+        return SweepCached(e, image, options);
+    const size_t start = options->offset + options->jump;
+    const size_t end = options->offset + image->size;
+    if (options->data)
+        return SweepData(e, image, options->offset, start, end);
+    if (options->threads > 1 && end > start)
+        return SweepParallel(e, image, options, start, end);
+    return SweepLinear(e, image, options->offset, start, end);
+}
+
+typedef struct {
+    const char* path;
+    /* listing rendered for the combined stream */
+    char* text;
+    size_t text_len;
+    size_t bytes;
+    /* errno of a failed file, 0 on success */
+    int error;
+    int done;
+} BatchJob;
+
+typedef struct {
+    BatchJob* jobs;
+    size_t count;
+    /* next job to hand out */
+    size_t next;
+    /* jobs already written to the combined stream */
+    size_t written;
+    /* how far workers may run ahead of the combined stream */
+    size_t window;
+    const Options* options;
+    /* write one listing per input here instead of one combined stream */
+    const char* out_dir;
+    /* where the workers' --stats counters are merged, or NULL */
+    Stats* stats;
+    /* --cache-dir, or NULL */
+    ListingCache* cache;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Batch;
+
+/* the file name part of a path, which --out-dir names its listings after */
+static inline const char* BaseName(const char* path) {
+    const char* name = strrchr(path, '/');
+    return name ? name + 1 : path;
+}
+
+/* write a listing that went through memory to its --out-dir file */
+static int SaveListing(const char* path, BatchJob* job) {
+    FILE* f = fopen(path, "wb");
+    int error = f && fwrite(job->text, 1, job->text_len, f) == job->text_len ? 0 : errno ? errno : EIO;
+    if (f && fclose(f) == EOF && !error)
+        error = errno;
+    free(job->text);
+    job->text = NULL;
+    return error;
+}
+
+/* disassemble one file of a batch; every worker owns its own emitter and
+ * image, so nothing but the job queue is shared between threads */
+static int BatchFile(Batch* batch, BatchJob* job, Emitter* e) {
+    Image image;
+    const size_t offset = batch->options->offset;
+    const double read_start = Now();
+    if (LoadImage(job->path, MEM_SIZE - offset, &image) < 0) {
+        return errno;
+    }
+    job->bytes = image.size;
+    if (e->stats) {
+        e->stats->read_seconds += Now() - read_start;
+        e->stats->bytes_read += image.size;
+        e->stats->files++;
+    }
+    /* nothing of the previous file is needed any more */
+    ArenaReset(e->arena);
+    if (image.size > MEM_SIZE - offset) {
+        FreeImage(&image);
+        return EFBIG;
+    }
+    char path[PATH_MAX];
+    if (batch->out_dir) {
+        const char* name = BaseName(job->path);
+        const char* ext = batch->options->format == FORMAT_BIN ? "rec" : "lst";
+        if (snprintf(path, sizeof(path), "%s/%s.%s", batch->out_dir, name, ext) >= (int)sizeof(path)) {
+            FreeImage(&image);
+            return ENAMETOOLONG;
+        }
+    }
+    /* a listing the cache holds is copied out without decoding anything */
+    ListingCache* cache = batch->cache;
+    EntryKey key;
+    if (cache) {
+        key = KeyImage(cache, image.data, image.size);
+        if (CacheLookup(cache, &key, &job->text, &job->text_len) == 0) {
+            FreeImage(&image);
+            return batch->out_dir ? SaveListing(path, job) : 0;
+        }
+    }
+    /* with a cache the listing goes through memory, to be stored as well */
+    FILE* out = batch->out_dir && !cache ? fopen(path, "wb") : open_memstream(&job->text, &job->text_len);
+    if (!out) {
+        FreeImage(&image);
+        return errno;
+    }
+    EmitterInit(e, out, batch->options->syntax);
+    e->name = job->path;
+    int error = 0;
+    /* -1 when the message is out already */
+    if (DisassembleImage(e, &image, batch->options) == EOF)
+        error = errno ? errno : -1;
+    if (fclose(out) == EOF && !error)
+        error = errno;
+    FreeImage(&image);
+    if (cache && !error) {
+        if (CacheStore(cache, &key, job->text, job->text_len) < 0)
+            fprintf(stderr, "%s: %s: cannot store the listing in %s: %s\n", batch->options->program_name,
+                    job->path, cache->dir, strerror(errno));
+        if (batch->out_dir)
+            error = SaveListing(path, job);
+    }
+    return error;
+}
+
+static void* BatchWorker(void* arg) {
+    Batch* batch = arg;
+    Emitter* e = malloc(sizeof(Emitter));
+    Stats* stats = batch->stats ? calloc(1, sizeof(Stats)) : NULL;
+    Arena arena = {0};
+    if (e) {
+        e->stats = stats;
+        e->arena = &arena;
+    }
+    if (batch->stats && !stats) {
+        free(e);
+        e = NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        /* keep the unwritten part of the combined stream bounded */
+        while (!batch->out_dir && batch->next < batch->count
+               && batch->next >= batch->written + batch->window)
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        if (batch->next >= batch->count) {
+            pthread_mutex_unlock(&batch->lock);
             break;
-        case 0xaf:
-            op.instruction = "XRA\tA";
+        }
+        BatchJob* job = &batch->jobs[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        job->error = e ? BatchFile(batch, job, e) : ENOMEM;
+
+        pthread_mutex_lock(&batch->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    if (stats) {
+        pthread_mutex_lock(&batch->lock);
+        StatsMerge(batch->stats, stats);
+        pthread_mutex_unlock(&batch->lock);
+        free(stats);
+    }
+    ArenaFree(&arena);
+    free(e);
+    return NULL;
+}
+
+/* read one path per line; blank lines and lines starting with '#' are skipped */
+static int ReadManifest(const char* manifest, const char*** paths, size_t* count) {
+    FILE* f = strcmp(manifest, "-") ? fopen(manifest, "r") : stdin;
+    if (!f) {
+        return -1;
+    }
+    size_t cap = *count;
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &line_cap, f)) != -1) {
+        while (n && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+            line[--n] = '\0';
+        if (!n || line[0] == '#')
+            continue;
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 256;
+            const char** grown = realloc(*paths, cap * sizeof(**paths));
+            if (!grown)
+                break;
+            *paths = grown;
+        }
+        if (!((*paths)[*count] = strdup(line)))
             break;
+        ++*count;
+    }
+    int error = ferror(f) || n != -1 ? -1 : 0;
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return error;
+}
+
+static int CompareBaseName(const void* a, const void* b) {
+    return strcmp(BaseName(*(const char* const*)a), BaseName(*(const char* const*)b));
+}
+
+/* two inputs of the same name would be listed to the same --out-dir file,
+ * possibly by two workers at once */
+static int CheckOutNames(const char* program_name, const char** paths, size_t count, const char* out_dir,
+                         const char* ext) {
+    const char** sorted = malloc((count ? count : 1) * sizeof(*sorted));
+    if (!sorted) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(sorted, paths, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), CompareBaseName);
+    int status = 0;
+    for (size_t i = 1; i < count && !status; ++i) {
+        if (!strcmp(BaseName(sorted[i - 1]), BaseName(sorted[i]))) {
+            fprintf(stderr, "%s: %s and %s would both be listed to %s/%s.%s\n", program_name, sorted[i - 1],
+                    sorted[i], out_dir, BaseName(sorted[i]), ext);
+            status = -1;
+        }
+    }
+    free(sorted);
+    return status;
+}
+
+/* disassemble every path across a pool of worker threads; the combined
+ * stream keeps the input order no matter which worker finishes first */
+static int RunBatch(const char* program_name, const char** paths, size_t count, size_t threads,
+                    const Options* options, const char* out_dir, FILE* output, Stats* stats, ListingCache* cache) {
+    const char* ext = options->format == FORMAT_BIN ? "rec" : "lst";
+    if (out_dir && CheckOutNames(program_name, paths, count, out_dir, ext) < 0)
+        return EXIT_FAILURE;
+    if (threads > count)
+        threads = count;
+    Batch batch = {
+            .count = count,
+            .window = threads * 4,
+            .options = options,
+            .out_dir = out_dir,
+            .stats = stats,
+            .cache = cache,
+    };
+    batch.jobs = calloc(count ? count : 1, sizeof(BatchJob));
+    if (!batch.jobs) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; ++i)
+        batch.jobs[i].path = paths[i];
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.cond, NULL);
+
+    const double start = Now();
+    pthread_t* workers = malloc(threads * sizeof(pthread_t));
+    size_t started = 0;
+    while (workers && started < threads && pthread_create(&workers[started], NULL, BatchWorker, &batch) == 0)
+        ++started;
+    int status = EXIT_SUCCESS;
+    size_t total = 0;
+    /* errno of the first failed write to the combined stream */
+    int write_error = 0;
+    if (!started) {
+        fprintf(stderr, "%s: could not start any worker threads\n", program_name);
+        status = EXIT_FAILURE;
+        goto done;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        BatchJob* job = &batch.jobs[i];
+        pthread_mutex_lock(&batch.lock);
+        while (!job->done)
+            pthread_cond_wait(&batch.cond, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        total += job->bytes;
+        if (job->error) {
+            if (job->error > 0)
+                fprintf(stderr, "%s: %s: %s\n", program_name, job->path, strerror(job->error));
+            status = EXIT_FAILURE;
+        } else if (!out_dir && (options->reassemble || !options->verify) && !write_error) {
+            if (fprintf(output, "; %s\n", job->path) < 0
+                || fwrite(job->text, 1, job->text_len, output) != job->text_len)
+                write_error = errno ? errno : EIO;
+        }
+        free(job->text);
+        job->text = NULL;
+
+        pthread_mutex_lock(&batch.lock);
+        batch.written = i + 1;
+        pthread_cond_broadcast(&batch.cond);
+        pthread_mutex_unlock(&batch.lock);
+    }
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    if (fflush(output) == EOF && !write_error)
+        write_error = errno;
+    if (write_error) {
+        fprintf(stderr, "%s: fwrite: %s\n", program_name, strerror(write_error));
+        status = EXIT_FAILURE;
+    }
+
+    const double elapsed = Now() - start;
+    fprintf(stderr, "%s: %zu files, %zu bytes in %.3f s on %zu threads: %.1f files/s, %.2f MB/s\n",
+            program_name, count, total, elapsed, started,
+            elapsed > 0 ? count / elapsed : 0.0, elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+    if (cache)
+        fprintf(stderr, "%s: %zu files listed from %s, %zu stored, %zu bytes in it\n",
+                program_name, cache->hits, cache->dir, cache->stored, cache->used);
+done:
+    pthread_cond_destroy(&batch.cond);
+    pthread_mutex_destroy(&batch.lock);
+    free(workers);
+    free(batch.jobs);
+    return status;
+}
+
+enum {
+    MIX_UNIFORM,
+    MIX_CODE,
+    MIX_OPERAND,
+};
+
+typedef struct {
+    int mix;
+    size_t size;
+    size_t iterations;
+    uint64_t seed;
+} BenchConfig;
+
+/* xorshift64*, so every run benchmarks exactly the same image */
+static inline uint64_t BenchRandom(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/* fill an image with a deterministic opcode mix: uniform random bytes,
+ * a well-formed stream of documented instructions, or a stream where
+ * most instructions are 3-byte LXI/JMP/CALL */
+static void BenchGenerate(uint8_t* image, size_t size, int mix, uint64_t seed) {
+    static const uint8_t wide[] = {0x01, 0x11, 0x21, 0x31, 0xc3, 0xcd};
+    uint64_t state = seed ? seed : 1;
+    for (size_t i = 0; i < size;) {
+        uint64_t r = BenchRandom(&state);
+        uint8_t opcode = r;
+        if (mix == MIX_UNIFORM) {
+            image[i++] = opcode;
+            continue;
+        }
+        if (mix == MIX_OPERAND && (r >> 8) % 10 < 6)
+            opcode = wide[(r >> 16) % sizeof(wide)];
+        while (disasm_ops[opcode].flags & OP_UNDOC)
+            opcode = BenchRandom(&state);
+        image[i++] = opcode;
+        for (uint8_t k = 1; k < disasm_ops[opcode].size && i < size; ++k)
+            image[i++] = BenchRandom(&state);
+    }
+}
+
+static int CompareDouble(const void* a, const void* b) {
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void BenchReport(FILE* out, const char* stage, double* samples, size_t n, size_t insns, size_t bytes) {
+    qsort(samples, n, sizeof(double), CompareDouble);
+    const double p50 = samples[n / 2];
+    const double p90 = samples[n * 9 / 10];
+    const double p99 = samples[n * 99 / 100];
+    fprintf(out, "%-10s %10.1f %10.1f %10.1f %10.2f %10.1f\n", stage, p50 * 1e6, p90 * 1e6, p99 * 1e6,
+            insns ? p50 * 1e9 / insns : 0.0, p50 > 0 ? bytes / p50 / 1e6 : 0.0);
+}
+
+/* time the load, decode and format stages separately over a synthetic
+ * image, plus the fused sweep the plain listing uses */
+static int RunBench(const Options* options, const BenchConfig* config, FILE* out) {
+    const char* program_name = options->program_name;
+    const size_t size = config->size;
+    const size_t iterations = config->iterations;
+    uint8_t* bytes = malloc(size);
+    Insn* insns = malloc((size + 1) * sizeof(Insn));
+    double* samples = malloc(iterations * sizeof(double));
+    Emitter* e = malloc(sizeof(Emitter));
+    FILE* sink = fopen("/dev/null", "wb");
+    const char* tmpdir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/disassembler-bench-XXXXXX", tmpdir ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    if (!bytes || !insns || !samples || !e || !sink || fd < 0) {
+        perror(program_name);
+        if (fd >= 0) {
+            close(fd);
+            unlink(path);
+        }
+        return EXIT_FAILURE;
+    }
+    e->stats = NULL;
+    e->arena = NULL;
+    BenchGenerate(bytes, size, config->mix, config->seed);
+    if (write(fd, bytes, size) != (ssize_t)size) {
+        perror(path);
+        close(fd);
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+    close(fd);
 
-        case 0xb0:
-            op.instruction = "ORA\tB";
-            break;
-        case 0xb1:
-            op.instruction = "ORA\tC";
-            break;
-        case 0xb2:
-            op.instruction = "ORA\tD";
-            break;
-        case 0xb3:
-            op.instruction = "ORA\tE";
-            break;
-        case 0xb4:
-            op.instruction = "ORA\tH";
-            break;
-        case 0xb5:
-            op.instruction = "ORA\tL";
-            break;
-        case 0xb6:
-            op.instruction = "ORA\tM";
-            break;
-        case 0xb7:
-            op.instruction = "ORA\tA";
-            break;
-        case 0xb8:
-            op.instruction = "CMP\tB";
-            break;
-        case 0xb9:
-            op.instruction = "CMP\tC";
-            break;
-        case 0xba:
-            op.instruction = "CMP\tD";
-            break;
-        case 0xbb:
-            op.instruction = "CMP\tE";
-            break;
-        case 0xbc:
-            op.instruction = "CMP\tH";
-            break;
-        case 0xbd:
-            op.instruction = "CMP\tL";
-            break;
-        case 0xbe:
-            op.instruction = "CMP\tM";
-            break;
-        case 0xbf:
-            op.instruction = "CMP\tA";
-            break;
+    const Image generated = {.data = bytes, .size = size};
+    const size_t base = options->offset;
+    const DisasmContext ctx = ImageContext(&generated, base);
+    const size_t n = DecodeRange(&ctx, base, base + size, insns, size + 1, NULL);
+    static const char* const mixes[] = {"uniform", "code", "operand"};
+    fprintf(out, "bench: %s mix, %zu bytes, %zu instructions, %zu iterations\n",
+            mixes[config->mix], size, n, iterations);
+    fprintf(out, "%-10s %10s %10s %10s %10s %10s\n", "stage", "p50 us", "p90 us", "p99 us", "ns/insn", "MB/s");
 
-        case 0xc0:
-            /* return if not zero */
-            op.instruction = "RNZ";
-            break;
-        case 0xc1:
-            op.instruction = "POP\tB";
-            break;
-        case 0xc2:
-            /* jump if not zero */
-            op.instruction = "JNZ\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xc3:
-            op.instruction = "JMP\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xc4:
-            /* call if not zero */
-            op.instruction = "CNZ\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xc5:
-            op.instruction = "PUSH\tB";
-            break;
-        case 0xc6:
-            /* immediate add */
-            op.instruction = "ADI\t%02x";
-            op.size = 2;
-            break;
-        case 0xc7:
-            op.instruction = "RST\t0";
-            break;
-        case 0xc8:
-            /* if zero, return */
-            op.instruction = "RZ";
-            break;
-        case 0xc9:
-            /* pop the address off the stack, assign to program counter */
-            op.instruction = "RET";
-            break;
-        case 0xca:
-            op.instruction = "JZ\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xcb:
-            op.instruction = "NOP";
-            /* blank instruction */
-            break;
-        case 0xcc:
-            op.instruction = "CZ\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xcd:
-            op.instruction = "CALL\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xce:
-            op.instruction = "ACI\t%02x";
-            op.size = 2;
-            break;
-        case 0xcf:
-            op.instruction = "RST\t1";
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < iterations; ++i) {
+        Image image;
+        const double start = Now();
+        if (LoadImage(path, MEM_SIZE, &image) < 0) {
+            perror(path);
+            status = EXIT_FAILURE;
             break;
+        }
+        samples[i] = Now() - start;
+        FreeImage(&image);
+    }
+    /* only the load stage reads the file, so nothing later can leave it behind */
+    unlink(path);
+    if (status == EXIT_SUCCESS)
+        BenchReport(out, "load", samples, iterations, n, size);
 
-        case 0xd0:
-            /* if no carry, return */
-            op.instruction = "RNC";
-            break;
-        case 0xd1:
-            op.instruction = "POP\tD";
-            break;
-        case 0xd2:
-            op.instruction = "JNC\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xd3:
-            /* send contents of Accumulator to Output Device #{Byte} */
-            op.instruction = "OUT\t%02x";
-            op.size = 2;
-            break;
-        case 0xd4:
-            /* if no carry, call */
-            op.instruction = "CNC\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xd5:
-            op.instruction = "PUSH\tD";
-            break;
-        case 0xd6:
-            /* immediate subtract */
-            op.instruction = "SUI\t%02x";
-            op.size = 2;
-            break;
-        case 0xd7:
-            op.instruction = "RST\t2";
-            break;
-        case 0xd8:
-            /* if carry, return */
-            op.instruction = "RC";
-            break;
-        case 0xd9:
-            op.instruction = "NOP";
-            /* blank instruction */
-            break;
-        case 0xda:
-            op.instruction = "JC\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xdb:
-            /* read 8 bits of data from Input Device ${Byte} into Accumulator */
-            op.instruction = "IN\t%02x";
-            op.size = 2;
-            break;
-        case 0xdc:
-            op.instruction = "CC\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xdd:
-            op.instruction = "NOP";
-            /* blank instruction */
-            break;
-        case 0xde:
-            /* immediate subtraction with carry */
-            op.instruction = "SBI\t%02x";
-            op.size = 2;
-            break;
-        case 0xdf:
-            op.instruction = "RST\t3";
-            break;
-        case 0xe0:
-            /* if PO, return */
-            op.instruction = "RPO";
-            break;
-        case 0xe1:
-            op.instruction = "POP\tH";
-            break;
-        case 0xe2:
-            op.instruction = "JPO\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xe3:
-            /* exchange stack with the contents of H/L */
-            op.instruction = "XTHL";
-            break;
-        case 0xe4:
-            op.instruction = "CPO\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xe5:
-            op.instruction = "PUSH\tH";
-            break;
-        case 0xe6:
-            op.instruction = "ANI\t%02x";
-            op.size = 2;
-            break;
-        case 0xe7:
-            op.instruction = "RST\t4";
-            break;
-        case 0xe8:
-            op.instruction = "RPE";
-            break;
-        case 0xe9:
-            op.instruction = "PCHL";
-            break;
-        case 0xea:
-            op.instruction = "JPE\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xeb:
-            op.instruction = "XCHG";
-            break;
-        case 0xec:
-            op.instruction = "CPE\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xed:
-            op.instruction = "NOP";
-            /* blank instruction */
-            break;
-        case 0xee:
-            /* immediate xor */
-            op.instruction = "XRI\t%02x";
-            op.size = 2;
-            break;
-        case 0xef:
-            op.instruction = "RST\t5";
-            break;
+    for (size_t i = 0; i < iterations; ++i) {
+        const double start = Now();
+        DecodeRange(&ctx, base, base + size, insns, size + 1, NULL);
+        samples[i] = Now() - start;
+    }
+    BenchReport(out, "decode", samples, iterations, n, size);
 
-        case 0xf0:
-            /* if P, return */
-            op.instruction = "RP";
-            break;
-        case 0xf1:
-            op.instruction = "POP\tPSW";
-            break;
-        case 0xf2:
-            op.instruction = "JP\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xf3:
-            op.instruction = "DI";
-            break;
-        case 0xf4:
-            op.instruction = "CP\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xf5:
-            op.instruction = "PUSH\tPSW";
-            break;
-        case 0xf6:
-            /* immediate or */
-            op.instruction = "ORI\t%02x";
-            op.size = 2;
-            break;
-        case 0xf7:
-            op.instruction = "RST\t6";
-            break;
-        case 0xf8:
-            /* if M, return */
-            op.instruction = "RM";
-            break;
-        case 0xf9:
-            op.instruction = "SPHL";
-            break;
-        case 0xfa:
-            op.instruction = "JM\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xfb:
-            op.instruction = "EI";
-            break;
-        case 0xfc:
-            op.instruction = "CM\t%02x%02x";
-            op.size = 3;
-            break;
-        case 0xfd:
-            op.instruction = "NOP";
-            /* blank instruction */
-            break;
-        case 0xfe:
-            op.instruction = "CPI\t%02x";
-            op.size = 2;
-            break;
-        case 0xff:
-            op.instruction = "RST\t7";
-            break;
+    /* the length prepass and the boundary walk over its result */
+    uint8_t* attrs = malloc(size);
+    if (!attrs) {
+        perror(program_name);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < iterations; ++i) {
+        const double start = Now();
+        ClassifyBytes(bytes, size, attrs);
+        samples[i] = Now() - start;
+    }
+    BenchReport(out, "classify", samples, iterations, n, size);
+    volatile size_t walked = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        const double start = Now();
+        size_t count = 0;
+        for (size_t k = 0; k < size; k += attrs[k] & ATTR_SIZE)
+            ++count;
+        walked = count;
+        samples[i] = Now() - start;
+    }
+    (void)walked;
+    BenchReport(out, "walk", samples, iterations, n, size);
+    free(attrs);
+
+    /* every syntax, so the specialised formatters can be held against
+     * the default one */
+    static const char* const format_stages[SYNTAX_COUNT] = {"format", "format/z80", "format/asm"};
+    static const char* const sweep_stages[SYNTAX_COUNT] = {"sweep", "sweep/z80", "sweep/asm"};
+    for (int syntax = 0; syntax < SYNTAX_COUNT; ++syntax) {
+        for (size_t i = 0; i < iterations; ++i) {
+            EmitterInit(e, sink, syntax);
+            const double start = Now();
+            EmitRecords(e, insns, n);
+            samples[i] = Now() - start;
+        }
+        BenchReport(out, format_stages[syntax], samples, iterations, n, size);
+    }
+
+    for (int syntax = 0; syntax < SYNTAX_COUNT; ++syntax) {
+        for (size_t i = 0; i < iterations; ++i) {
+            EmitterInit(e, sink, syntax);
+            const double start = Now();
+            SweepLinear(e, &generated, base, base, base + size);
+            samples[i] = Now() - start;
+        }
+        BenchReport(out, sweep_stages[syntax], samples, iterations, n, size);
     }
-    return op;
+
+    /* the labelled listing out of one arena, reset between runs the way
+     * a batch worker does between files */
+    Options labeled = *options;
+    labeled.labels = 1;
+    labeled.recursive = 0;
+    labeled.format = FORMAT_TEXT;
+    labeled.jump = 0;
+    Arena arena = {0};
+    for (size_t i = 0; i < iterations; ++i) {
+        EmitterInit(e, sink, SYNTAX_INTEL);
+        e->arena = &arena;
+        ArenaReset(&arena);
+        const double start = Now();
+        DecodeAndWrite(e, &generated, &labeled);
+        samples[i] = Now() - start;
+    }
+    BenchReport(out, "labels", samples, iterations, n, size);
+    fprintf(out, "arena: %zu allocations over %zu runs, %zu bytes\n", arena.allocations, iterations,
+            arena.head ? arena.head->size : 0);
+    ArenaFree(&arena);
+
+    /* the control-flow graph of the decoded image, which has to stay
+     * cheap enough to rebuild on every edit */
+    for (size_t i = 0; i < iterations; ++i) {
+        ArenaReset(&arena);
+        if (ArenaReserve(&arena, CfgBytes(n)) < 0) {
+            perror(program_name);
+            return EXIT_FAILURE;
+        }
+        Cfg cfg;
+        const double start = Now();
+        BuildCfg(&cfg, insns, n, &arena);
+        samples[i] = Now() - start;
+    }
+    BenchReport(out, "cfg", samples, iterations, n, size);
+
+    /* the --data heuristics on their own, one pass over the bytes */
+    for (size_t i = 0; i < iterations; ++i) {
+        ArenaReset(&arena);
+        const size_t max = size / 2 + 4;
+        DataRegion* regions = ArenaAlloc(&arena, max * sizeof(DataRegion));
+        if (!regions) {
+            perror(program_name);
+            return EXIT_FAILURE;
+        }
+        const double start = Now();
+        FindDataRegions(&ctx, base, base + size, regions, max);
+        samples[i] = Now() - start;
+    }
+    BenchReport(out, "data", samples, iterations, n, size);
+    ArenaFree(&arena);
+
+    fclose(sink);
+    free(e);
+    free(samples);
+    free(insns);
+    free(bytes);
+    return status;
+}
+
+/* strtol with the same error handling as --offset and --jump */
+static int ParseNumber(const char* program_name, const char* arg, long min, long max, long* value) {
+    errno = 0;
+    char* end;
+    *value = strtol(arg, &end, 0);
+    if (errno) {
+        perror("strtol");
+        return -1;
+    }
+    if (end == arg || *end || *value < min || *value > max) {
+        fprintf(stderr, "%s: %s is not a number between %ld and %ld\n", program_name, arg, min, max);
+        return -1;
+    }
+    return 0;
+}
+
+/* long options without a short form */
+enum {
+    OPT_FORMAT = 0x100,
+    OPT_FROM_BIN,
+    OPT_ASSEMBLE,
+    OPT_BENCH,
+    OPT_LABELS,
+    OPT_SYMBOLS,
+    OPT_BENCH_MIX,
+    OPT_BENCH_SIZE,
+    OPT_BENCH_ITERS,
+    OPT_CACHE,
+    OPT_SYNTAX,
+    OPT_BANK,
+    OPT_BANK_MAP,
+    OPT_BANK_SIZE,
+    OPT_STATS,
+    OPT_XREF_OUT,
+    OPT_XREF,
+    OPT_RANGE,
+    OPT_COUNT,
+    OPT_EMIT,
+    OPT_PC_TRACE,
+    OPT_TRACE_FORMAT,
+    OPT_CFG_DOT,
+    OPT_CFG_BIN,
+    OPT_DATA,
+    OPT_ASM,
+    OPT_VERIFY,
+    OPT_CACHE_DIR,
+    OPT_CACHE_MAX,
+};
+
+/* --stats goes to stderr unless it was given a file */
+static int ReportStats(const char* path, const Stats* stats) {
+    FILE* out = path ? fopen(path, "w") : stderr;
+    if (!out || WriteStats(out, stats) == EOF) {
+        perror(path ? path : "stderr");
+        if (out && out != stderr)
+            fclose(out);
+        return EXIT_FAILURE;
+    }
+    if (out != stderr && fclose(out) == EOF) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
-#define MEM_SIZE 0x10000
-uint8_t memory[MEM_SIZE];
 int main(int argc, char** argv)
 {
     const char* program_name = argv[0];
     static struct option const long_options[] = {
             {"offset", required_argument, NULL, 'f'},
             {"jump", required_argument, NULL, 'j'},
+            {"recursive", no_argument, NULL, 'r'},
+            {"batch", no_argument, NULL, 'b'},
+            {"manifest", required_argument, NULL, 'm'},
+            {"threads", required_argument, NULL, 't'},
+            {"out-dir", required_argument, NULL, 'd'},
+            {"format", required_argument, NULL, OPT_FORMAT},
+            {"from-bin", no_argument, NULL, OPT_FROM_BIN},
+            {"assemble", no_argument, NULL, OPT_ASSEMBLE},
+            {"labels", no_argument, NULL, OPT_LABELS},
+            {"symbols", required_argument, NULL, OPT_SYMBOLS},
+            {"bench", no_argument, NULL, OPT_BENCH},
+            {"bench-mix", required_argument, NULL, OPT_BENCH_MIX},
+            {"bench-size", required_argument, NULL, OPT_BENCH_SIZE},
+            {"bench-iters", required_argument, NULL, OPT_BENCH_ITERS},
+            {"cache", required_argument, NULL, OPT_CACHE},
+            {"syntax", required_argument, NULL, OPT_SYNTAX},
+            {"bank", required_argument, NULL, OPT_BANK},
+            {"bank-map", required_argument, NULL, OPT_BANK_MAP},
+            {"bank-size", required_argument, NULL, OPT_BANK_SIZE},
+            {"stats", optional_argument, NULL, OPT_STATS},
+            {"xref-out", required_argument, NULL, OPT_XREF_OUT},
+            {"xref", required_argument, NULL, OPT_XREF},
+            {"range", required_argument, NULL, OPT_RANGE},
+            {"count", required_argument, NULL, OPT_COUNT},
+            {"emit", required_argument, NULL, OPT_EMIT},
+            {"pc-trace", required_argument, NULL, OPT_PC_TRACE},
+            {"trace-format", required_argument, NULL, OPT_TRACE_FORMAT},
+            {"cfg-dot", required_argument, NULL, OPT_CFG_DOT},
+            {"cfg-bin", required_argument, NULL, OPT_CFG_BIN},
+            {"data", no_argument, NULL, OPT_DATA},
+            {"asm", no_argument, NULL, OPT_ASM},
+            {"verify", no_argument, NULL, OPT_VERIFY},
+            {"cache-dir", required_argument, NULL, OPT_CACHE_DIR},
+            {"cache-max", required_argument, NULL, OPT_CACHE_MAX},
             {"version", no_argument, NULL, 'v'},
             {"help", no_argument, NULL, 'h'},
             {NULL, 0, NULL, 0},
     };
     int c;
+    Options options = {0};
     size_t offset = 0;
     size_t jump = 0;
     FILE *output = stdout;
-    while ((c = getopt_long(argc, argv, "vhj:f:o:", long_options, NULL)) != -1) {
+    const char* output_path = NULL;
+    int batch = 0;
+    int from_bin = 0;
+    int assemble = 0;
+    const char* manifest = NULL;
+    const char* out_dir = NULL;
+    long threads = 0;
+    int bench = 0;
+    const char* symbols_path = NULL;
+    SymbolTable symbols = {0};
+    char* symbols_text = NULL;
+    BenchConfig bench_config = {MIX_OPERAND, MEM_SIZE, 200, 0x8080};
+    BankConfig bank_config = {.size = BANK_SIZE};
+    int banked = 0;
+    size_t bank_offset, bank_base;
+    static Stats stats;
+    int collect_stats = 0;
+    const char* stats_path = NULL;
+    size_t xref_targets[MAX_ENTRIES];
+    size_t n_xref_targets = 0;
+    const char* trace_path = NULL;
+    int trace_format = TRACE_BIN;
+    static uint64_t executed[BITMAP_WORDS];
+    const char* cache_dir = NULL;
+    size_t cache_max = CACHE_MAX_DEFAULT;
+    long value;
+    while ((c = getopt_long(argc, argv, "vhj:f:o:rbm:t:d:", long_options, NULL)) != -1) {
         switch (c) {
             /* "jump" to a disassembly point */
             case 'j':
@@ -908,14 +4905,16 @@ int main(int argc, char** argv)
                     fprintf(stderr, "%s: jump point is bigger than the cpu memory\n", program_name);
                     return EXIT_FAILURE;
                 }
+                /* every jump point is also an entry for --recursive */
+                if (options.n_entries == MAX_ENTRIES) {
+                    fprintf(stderr, "%s: too many jump points\n", program_name);
+                    return EXIT_FAILURE;
+                }
+                options.entries[options.n_entries++] = jump;
                 break;
             /* specify output file */
             case 'o':
-                output = fopen(optarg, "w+b");
-                if (!output) {
-                    perror("fopen");
-                    return errno;
-                }
+                output_path = optarg;
                 break;
             /* specify offset */
             case 'f':
@@ -932,15 +4931,406 @@ int main(int argc, char** argv)
                     return EXIT_FAILURE;
                 }
                 break;
+            /* follow control flow instead of sweeping linearly */
+            case 'r':
+                options.recursive = 1;
+                break;
+            /* output format: text listing or binary records */
+            case OPT_FORMAT:
+                if (!strcmp(optarg, "text")) {
+                    options.format = FORMAT_TEXT;
+                } else if (!strcmp(optarg, "bin")) {
+                    options.format = FORMAT_BIN;
+                } else {
+                    fprintf(stderr, "%s: unknown format %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            /* input is a --format=bin record file to list as text */
+            case OPT_FROM_BIN:
+                from_bin = 1;
+                break;
+            /* input is source to assemble into the bytes it stands for */
+            case OPT_ASSEMBLE:
+                assemble = 1;
+                break;
+            /* label branch and data targets */
+            case OPT_LABELS:
+                options.labels = 1;
+                break;
+            /* names for addresses, e.g. the CP/M BDOS entry points; implies --labels */
+            case OPT_SYMBOLS:
+                options.labels = 1;
+                symbols_path = optarg;
+                break;
+            /* time the decoder on a synthetic image instead of disassembling */
+            case OPT_BENCH:
+                bench = 1;
+                break;
+            case OPT_BENCH_MIX:
+                if (!strcmp(optarg, "uniform")) {
+                    bench_config.mix = MIX_UNIFORM;
+                } else if (!strcmp(optarg, "code")) {
+                    bench_config.mix = MIX_CODE;
+                } else if (!strcmp(optarg, "operand")) {
+                    bench_config.mix = MIX_OPERAND;
+                } else {
+                    fprintf(stderr, "%s: unknown opcode mix %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_BENCH_SIZE:
+                if (ParseNumber(program_name, optarg, 1, MEM_SIZE, &value) < 0)
+                    return EXIT_FAILURE;
+                bench_config.size = value;
+                break;
+            case OPT_BENCH_ITERS:
+                if (ParseNumber(program_name, optarg, 1, 1000000, &value) < 0)
+                    return EXIT_FAILURE;
+                bench_config.iterations = value;
+                break;
+            /* reuse the previous listing of this image, redoing only what changed */
+            case OPT_CACHE:
+                options.cache = optarg;
+                break;
+            /* mnemonics and number format of the listing */
+            case OPT_SYNTAX:
+                options.syntax = -1;
+                for (int i = 0; i < SYNTAX_COUNT; ++i)
+                    if (!strcmp(optarg, disasm_syntax_names[i]))
+                        options.syntax = i;
+                if (options.syntax < 0) {
+                    fprintf(stderr, "%s: unknown syntax %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            /* the bank at file offset OFFSET is mapped at cpu address BASE */
+            case OPT_BANK:
+                if (ParseBank(optarg, &bank_offset, &bank_base) < 0) {
+                    fprintf(stderr, "%s: expected OFFSET=ADDRESS for a bank, not %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                if (BankConfigAdd(&bank_config, bank_offset, bank_base) < 0) {
+                    perror("realloc");
+                    return EXIT_FAILURE;
+                }
+                banked = 1;
+                break;
+            /* the same, one OFFSET ADDRESS pair per line */
+            case OPT_BANK_MAP:
+                if (LoadBankMap(optarg, &bank_config) < 0) {
+                    perror(optarg);
+                    return EXIT_FAILURE;
+                }
+                banked = 1;
+                break;
+            case OPT_BANK_SIZE:
+                if (ParseNumber(program_name, optarg, 1, MEM_SIZE, &value) < 0)
+                    return EXIT_FAILURE;
+                bank_config.size = value;
+                banked = 1;
+                break;
+            /* opcode histogram and phase times as JSON, to stderr or a file */
+            case OPT_STATS:
+                collect_stats = 1;
+                stats_path = optarg;
+                break;
+            /* save a cross-reference index of the listing */
+            case OPT_XREF_OUT:
+                options.xref = optarg;
+                break;
+            /* look an address up in a saved index instead of disassembling */
+            case OPT_XREF:
+                if (n_xref_targets == MAX_ENTRIES) {
+                    fprintf(stderr, "%s: too many cross-reference queries\n", program_name);
+                    return EXIT_FAILURE;
+                }
+                if (ParseOffset(optarg, &xref_targets[n_xref_targets]) < 0
+                    || xref_targets[n_xref_targets] >= MEM_SIZE) {
+                    fprintf(stderr, "%s: %s is not a cpu address\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                n_xref_targets++;
+                break;
+            /* list only [BANK:]START:END, END defaulting to the end of the image */
+            case OPT_RANGE:
+                if (options.n_ranges == MAX_RANGES) {
+                    fprintf(stderr, "%s: too many ranges\n", program_name);
+                    return EXIT_FAILURE;
+                }
+                if (ParseRange(optarg, options.ranges[options.n_ranges], &options.range_banks[options.n_ranges]) < 0) {
+                    fprintf(stderr, "%s: expected [BANK:]START:END for a range, not %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                options.n_ranges++;
+                break;
+            /* stop after this many instructions */
+            case OPT_COUNT:
+                if (ParseNumber(program_name, optarg, 1, MEM_SIZE, &value) < 0)
+                    return EXIT_FAILURE;
+                options.count = value;
+                break;
+            /* KIND=FILE: render the listing to FILE as text, json or bin
+             * records; given once or more, it replaces -o and stdout */
+            case OPT_EMIT:
+                if (options.n_emits == MAX_EMITS) {
+                    fprintf(stderr, "%s: too many outputs\n", program_name);
+                    return EXIT_FAILURE;
+                }
+                if (ParseEmit(optarg, &options.emits[options.n_emits].kind, &options.emits[options.n_emits].path)
+                    < 0) {
+                    fprintf(stderr, "%s: expected text, json or bin=FILE, not %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                options.n_emits++;
+                break;
+            /* code is what an emulator ran, everything else is data */
+            case OPT_PC_TRACE:
+                trace_path = optarg;
+                break;
+            /* bin: 16-bit little-endian words, text: a hex address per line */
+            case OPT_TRACE_FORMAT:
+                if (!strcmp(optarg, "bin")) {
+                    trace_format = TRACE_BIN;
+                } else if (!strcmp(optarg, "text")) {
+                    trace_format = TRACE_TEXT;
+                } else {
+                    fprintf(stderr, "%s: unknown trace format %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            /* save the basic blocks and their edges as Graphviz */
+            case OPT_CFG_DOT:
+                options.cfg_dot = optarg;
+                break;
+            /* or as flat arrays */
+            case OPT_CFG_BIN:
+                options.cfg_bin = optarg;
+                break;
+            /* list strings, jump tables and fill runs as data */
+            case OPT_DATA:
+                options.data = 1;
+                break;
+            /* write source that assembles back to the image */
+            case OPT_ASM:
+                options.reassemble = 1;
+                break;
+            /* check that it does, byte for byte */
+            case OPT_VERIFY:
+                options.verify = 1;
+                break;
+            /* keep the listings of a batch here for every later batch */
+            case OPT_CACHE_DIR:
+                cache_dir = optarg;
+                break;
+            /* and let it grow to this many bytes, with a K, M or G suffix */
+            case OPT_CACHE_MAX:
+                if (ParseSize(optarg, &cache_max) < 0) {
+                    fprintf(stderr, "%s: expected a size such as 512M, not %s\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            /* disassemble many files in one run */
+            case 'b':
+                batch = 1;
+                break;
+            /* read batch inputs from a file, one path per line */
+            case 'm':
+                batch = 1;
+                manifest = optarg;
+                break;
+            /* number of worker threads */
+            case 't':
+                errno = 0;
+                threads = strtol(optarg, NULL, 0);
+                if (errno) {
+                    perror("strtol");
+                    return errno;
+                }
+                if (threads < 1) {
+                    fprintf(stderr, "%s: need at least one thread\n", program_name);
+                    return EXIT_FAILURE;
+                }
+                break;
+            /* write one listing per batch input into this directory */
+            case 'd':
+                batch = 1;
+                out_dir = optarg;
+                break;
             default:
                 break;
         }
     }
+    /* opened only once the options are known, so one that -o conflicts
+     * with does not leave it truncated */
+    if (output_path && options.n_emits) {
+        fprintf(stderr, "%s: --emit writes its own files, so -o has nothing to take\n", program_name);
+        return EXIT_FAILURE;
+    }
+    if (output_path) {
+        output = fopen(output_path, "w+b");
+        if (!output) {
+            perror("fopen");
+            return errno;
+        }
+    }
     /* handle combination of jump and offset */
     if (jump + offset >= MEM_SIZE) {
         fprintf(stderr, "%s: start point is bigger than the cpu memory\n", program_name);
         return EXIT_FAILURE;
     }
+    options.program_name = program_name;
+    options.offset = offset;
+    options.threads = threads;
+    if (symbols_path) {
+        if (LoadSymbols(symbols_path, &symbols, &symbols_text) < 0) {
+            perror(symbols_path);
+            return EXIT_FAILURE;
+        }
+        options.symbols = &symbols;
+    }
+    if (bench) {
+        if (bench_config.size > MEM_SIZE - offset)
+            bench_config.size = MEM_SIZE - offset;
+        int status = RunBench(&options, &bench_config, output);
+        if (output != stdout)
+            fclose(output);
+        return status;
+    }
+    options.jump = jump;
+    bank_config.base = offset;
+    /* a count on its own is taken from the jump point */
+    if (options.count && !options.n_ranges) {
+        options.ranges[0][0] = offset + jump;
+        options.ranges[0][1] = SIZE_MAX;
+        options.range_banks[0] = ANY_BANK;
+        options.n_ranges = 1;
+    }
+    if (trace_path) {
+        if (options.recursive || batch) {
+            fprintf(stderr, "%s: a trace marks the code of one file and replaces --recursive\n", program_name);
+            return EXIT_FAILURE;
+        }
+        const size_t readers = threads > 1 ? (size_t)threads : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+        if (LoadTrace(trace_path, trace_format, readers, executed) < 0) {
+            perror(trace_path);
+            return EXIT_FAILURE;
+        }
+        options.executed = executed;
+    }
+    if (options.n_emits
+        && (batch || options.labels || options.xref || options.cache || options.cfg_dot || options.cfg_bin)) {
+        fprintf(stderr, "%s: --emit lists one file without labels, an index, a graph or a cache\n", program_name);
+        return EXIT_FAILURE;
+    }
+    if (options.data
+        && (Marked(&options) || options.labels || options.format != FORMAT_TEXT || options.xref || options.cfg_dot
+            || options.cfg_bin || options.n_emits || options.cache || banked)) {
+        fprintf(stderr, "%s: --data changes the plain linear listing and works with nothing that replaces it\n",
+                program_name);
+        return EXIT_FAILURE;
+    }
+    if ((options.reassemble || options.verify)
+        && (options.format != FORMAT_TEXT || options.n_emits || options.cache || options.data || banked || from_bin)) {
+        fprintf(stderr, "%s: --asm and --verify make a text listing of their own\n", program_name);
+        return EXIT_FAILURE;
+    }
+    /* an assembler only takes the asm syntax, and wants labels */
+    if (options.reassemble || options.verify) {
+        options.syntax = SYNTAX_ASM;
+        options.labels = 1;
+    }
+    if (options.n_ranges && options.cache) {
+        fprintf(stderr, "%s: --cache holds a whole listing and does not work with --range or --count\n",
+                program_name);
+        return EXIT_FAILURE;
+    }
+    if (collect_stats && options.cache) {
+        fprintf(stderr, "%s: --stats times a full decode and does not work with --cache\n", program_name);
+        return EXIT_FAILURE;
+    }
+    if (batch && (options.xref || options.cfg_dot || options.cfg_bin)) {
+        fprintf(stderr, "%s: --xref-out and --cfg-dot/--cfg-bin describe one file at a time\n", program_name);
+        return EXIT_FAILURE;
+    }
+    if (banked
+        && (batch || options.recursive || options.format != FORMAT_TEXT || options.cache || options.xref
+            || options.n_emits || options.executed || options.cfg_dot || options.cfg_bin || jump)) {
+        fprintf(stderr, "%s: banked images are only listed linearly, as text, one file at a time\n", program_name);
+        return EXIT_FAILURE;
+    }
+    if (banked && options.n_ranges && options.labels) {
+        fprintf(stderr, "%s: --labels names the whole banked image and does not work with --range or --count\n",
+                program_name);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < options.n_ranges && !banked; ++i) {
+        if (options.range_banks[i] != ANY_BANK) {
+            fprintf(stderr, "%s: a range names a bank but the image is not banked\n", program_name);
+            return EXIT_FAILURE;
+        }
+    }
+    if (batch) {
+        const char** paths = NULL;
+        size_t count = 0;
+        if (manifest && ReadManifest(manifest, &paths, &count) < 0) {
+            perror(manifest);
+            return EXIT_FAILURE;
+        }
+        const size_t listed = count;
+        if (optind < argc) {
+            paths = realloc(paths, (count + argc - optind) * sizeof(*paths));
+            if (!paths) {
+                perror("realloc");
+                return EXIT_FAILURE;
+            }
+            while (optind < argc)
+                paths[count++] = argv[optind++];
+        }
+        if (!count) {
+            fprintf(stderr, "%s: expected arguments\n", program_name);
+            return EXIT_FAILURE;
+        }
+        if (options.cache) {
+            fprintf(stderr, "%s: --cache holds a single image and does not work in batch mode\n", program_name);
+            return EXIT_FAILURE;
+        }
+        if (cache_dir && collect_stats) {
+            fprintf(stderr, "%s: --stats times a full decode and does not work with --cache-dir\n", program_name);
+            return EXIT_FAILURE;
+        }
+        if (options.format == FORMAT_BIN && !out_dir) {
+            fprintf(stderr, "%s: binary records need --out-dir in batch mode\n", program_name);
+            return EXIT_FAILURE;
+        }
+        /* the workers already fill every core, so each file is swept on one */
+        options.threads = 1;
+        if (!threads)
+            threads = sysconf(_SC_NPROCESSORS_ONLN);
+        static ListingCache cache;
+        if (cache_dir) {
+            cache = (ListingCache){.dir = cache_dir, .max = cache_max, .salt = CacheSalt(&options)};
+            pthread_mutex_init(&cache.lock, NULL);
+            if ((mkdir(cache_dir, 0777) < 0 && errno != EEXIST) || CacheTrim(&cache) < 0) {
+                perror(cache_dir);
+                return EXIT_FAILURE;
+            }
+        }
+        int status = RunBatch(program_name, paths, count, threads > 0 ? threads : 1, &options, out_dir, output,
+                              collect_stats ? &stats : NULL, cache_dir ? &cache : NULL);
+        if (collect_stats && ReportStats(stats_path, &stats) != EXIT_SUCCESS)
+            status = EXIT_FAILURE;
+        for (size_t i = 0; i < listed; ++i)
+            free((char*)paths[i]);
+        free(paths);
+        if (output != stdout)
+            fclose(output);
+        return status;
+    }
+    if (cache_dir) {
+        fprintf(stderr, "%s: --cache-dir shares listings between batch runs; --cache keeps one file\n", program_name);
+        return EXIT_FAILURE;
+    }
     if (optind >= argc) {
         fprintf(stderr, "%s: expected arguments\n", program_name);
         return EXIT_FAILURE;
@@ -949,58 +5339,134 @@ int main(int argc, char** argv)
         fprintf(stderr, "%s: too many arguments\n", program_name);
         return EXIT_FAILURE;
     }
-    FILE* asmb = fopen(argv[optind], "r");
-    if (!asmb) {
-        perror("fopen");
-        exit(EXIT_FAILURE);
+    Image image;
+    static Emitter emitter;
+    static Arena arena;
+    EmitterInit(&emitter, output, options.syntax);
+    emitter.arena = &arena;
+    emitter.name = argv[optind];
+    if (collect_stats) {
+        emitter.stats = &stats;
+        stats.files = 1;
     }
-
-    if (fseek(asmb, 0L, SEEK_END) == EOF) {
-        perror("fseek");
-        exit(EXIT_FAILURE);
+    if (from_bin) {
+        if (LoadImage(argv[optind], SIZE_MAX - 1, &image) < 0 || ReadRecords(&emitter, &image) == EOF) {
+            perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        FreeImage(&image);
+        if (output != stdout)
+            fclose(output);
+        exit(EXIT_SUCCESS);
     }
-    const size_t bytes_read = ftell(asmb);
-    if (bytes_read >= MEM_SIZE) {
-        fprintf(stderr, "%s: file size %lu is bigger than the cpu memory", program_name, bytes_read);
+    if (assemble) {
+        if (LoadImage(argv[optind], SIZE_MAX - 1, &image) < 0
+            || WriteAssembled(&emitter, &image, &arena, program_name) == EOF) {
+            /* errno is clear when the message has been printed already */
+            if (errno)
+                perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        FreeImage(&image);
+        if (output != stdout)
+            fclose(output);
+        exit(EXIT_SUCCESS);
     }
-    rewind(asmb);
-
-    /* read file into memory */
-    uint8_t* bufp = memory + offset;
-    fread(bufp, 1, bytes_read, asmb);
-    if (ferror(asmb)) {
-        perror("fread");
+    /* the argument is an index saved by --xref-out */
+    if (n_xref_targets) {
+        if (LoadImage(argv[optind], SIZE_MAX - 1, &image) < 0) {
+            perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < n_xref_targets; ++i) {
+            if (QueryXref(&emitter, &image, xref_targets[i]) == EOF) {
+                perror(argv[optind]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        FreeImage(&image);
+        if (output != stdout)
+            fclose(output);
+        exit(EXIT_SUCCESS);
+    }
+    struct stat st;
+    const int from_stdin = !strcmp(argv[optind], "-");
+    double read_start;
+    if (banked) {
+        int status;
+        if (!options.labels
+            && (from_stdin ? fstat(STDIN_FILENO, &st) : stat(argv[optind], &st)) == 0 && !S_ISREG(st.st_mode)) {
+            int fd = from_stdin ? STDIN_FILENO : open(argv[optind], O_RDONLY);
+            if (fd < 0) {
+                perror(argv[optind]);
+                exit(EXIT_FAILURE);
+            }
+            status = SweepBankStream(&emitter, fd, &options, &bank_config);
+            if (!from_stdin)
+                close(fd);
+        } else {
+            read_start = Now();
+            if (LoadImage(argv[optind], SIZE_MAX - 1, &image) < 0) {
+                perror(argv[optind]);
+                exit(EXIT_FAILURE);
+            }
+            stats.read_seconds = Now() - read_start;
+            stats.bytes_read = image.size;
+            status = SweepBanks(&emitter, &image, &options, &bank_config);
+            FreeImage(&image);
+        }
+        /* errno is clear when the message has been printed already */
+        if (status == EOF) {
+            if (errno)
+                perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        free(bank_config.map);
+        if (output != stdout)
+            fclose(output);
+        exit(collect_stats ? ReportStats(stats_path, &stats) : EXIT_SUCCESS);
+    }
+    /* pipes are decoded as they arrive when nothing needs the whole image */
+    if (PlainSweep(&options) && !collect_stats
+        && (from_stdin ? fstat(STDIN_FILENO, &st) : stat(argv[optind], &st)) == 0 && !S_ISREG(st.st_mode)) {
+        int fd = from_stdin ? STDIN_FILENO : open(argv[optind], O_RDONLY);
+        if (fd < 0) {
+            perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        if (SweepStream(&emitter, fd, &options) == EOF) {
+            perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        if (!from_stdin)
+            close(fd);
+        if (output != stdout)
+            fclose(output);
+        exit(EXIT_SUCCESS);
+    }
+    read_start = Now();
+    if (LoadImage(argv[optind], MEM_SIZE - offset, &image) < 0) {
+        perror(argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    stats.read_seconds = Now() - read_start;
+    stats.bytes_read = image.size;
+    if (image.size > MEM_SIZE - offset) {
+        fprintf(stderr, "%s: file size %lu is bigger than the cpu memory\n", program_name, image.size);
         exit(EXIT_FAILURE);
     }
-    /* buffer is now full; file is read */
-    /* file can now be closed */
-    fclose(asmb);
 
     /* now it's time to do our disassembly */
-    for (size_t count = offset + jump; count < bytes_read; ++count) {
-        Op op = Disassemble(memory[count]);
-        uint8_t a, b;
-        /* count the current hex byte */
-        fprintf(output, "%04lx: ", count);
-        switch (op.size) {
-            case 1:
-                fprintf(output, "%s", op.instruction);
-                break;
-            case 2:
-                a = memory[++count];
-                fprintf(output, op.instruction, a);
-                break;
-            case 3:
-                a = memory[++count];
-                b = memory[++count];
-                fprintf(output, op.instruction, a, b);
-                break;
-        }
-        fprintf(output, "\n");
+    if (DisassembleImage(&emitter, &image, &options) == EOF) {
+        /* errno is clear when the message has been printed already */
+        if (errno)
+            perror("fwrite");
+        exit(EXIT_FAILURE);
     }
+    FreeImage(&image);
 
     if (output != stdout)
         fclose(output);
 
-    exit(EXIT_SUCCESS);
+    exit(collect_stats ? ReportStats(stats_path, &stats) : EXIT_SUCCESS);
 }
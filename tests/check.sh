@@ -0,0 +1,363 @@
+#!/bin/sh
+# regression checks for the disassembler: each section holds one feature
+# to saved output, or to another way of getting the same result.
+# opcodes.bin holds the 256 opcodes in order, every word operand 1234
+#
+# usage: tests/check.sh ./disassembler tests/listlib, or make check
+
+disassembler=${1:-./disassembler}
+dir=$(dirname "$0")
+listlib=${2:-$dir/listlib}
+image=$dir/opcodes.bin
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+fail() {
+    echo "FAIL: $*" >&2
+    failed=1
+}
+
+# the listing of every opcode, as the original printf loop wrote it
+"$disassembler" "$image" | cmp -s - "$dir/opcodes.lst" || fail "default listing"
+: > "$tmp/empty.bin"
+[ -z "$("$disassembler" "$tmp/empty.bin")" ] || fail "empty image"
+
+# an instruction cut short by the end of the image reads zeros past it
+printf '\000\303\064' > "$tmp/tail.bin"
+printf '0000: NOP\n0001: JMP\t3400\n' > "$tmp/tail.lst"
+"$disassembler" "$tmp/tail.bin" | cmp -s - "$tmp/tail.lst" || fail "instruction past the image end"
+
+# the mapped image fills the whole cpu memory, and not a byte more
+dd if=/dev/zero of="$tmp/full.bin" bs=1024 count=64 2> /dev/null
+[ "$("$disassembler" "$tmp/full.bin" | tail -n 1)" = "ffff: NOP" ] || fail "64 KiB image"
+printf '\000' >> "$tmp/full.bin"
+"$disassembler" "$tmp/full.bin" > /dev/null 2>&1 && fail "image bigger than the cpu memory"
+"$disassembler" "$tmp/missing.bin" 2> /dev/null && fail "missing image"
+
+# a batch writes each file's listing under its own name, from a list of
+# arguments or from a manifest, on any number of threads
+mkdir "$tmp/batch" "$tmp/manifest"
+"$disassembler" -d "$tmp/batch" "$image" "$tmp/tail.bin" 2> /dev/null || fail "batch"
+cmp -s "$tmp/batch/opcodes.bin.lst" "$dir/opcodes.lst" && cmp -s "$tmp/batch/tail.bin.lst" "$tmp/tail.lst" \
+    || fail "batch listings"
+printf '%s\n%s\n' "$image" "$tmp/tail.bin" > "$tmp/files"
+"$disassembler" -t 4 -m "$tmp/files" -d "$tmp/manifest" 2> /dev/null && diff -r "$tmp/batch" "$tmp/manifest" > /dev/null \
+    || fail "batch from a manifest"
+
+# recursive descent follows the jump and the call; what they skip is data
+printf '\303\006\000\377\377\377\315\013\000\166\377\076\001\311' > "$tmp/flow.bin"
+printf '%s\n' '0000: JMP	0600' '0003: DB	ff,ff,ff' '0006: CALL	0b00' '0009: HLT' '000a: DB	ff' \
+    '000b: MVI	A,01' '000d: RET' > "$tmp/flow.lst"
+"$disassembler" -r "$tmp/flow.bin" | cmp -s - "$tmp/flow.lst" || fail "recursive listing"
+
+# chunks swept on other threads resynchronise to the one sweep. The
+# random bytes end in three NOPs so no instruction runs off the image
+head -c 65533 /dev/urandom > "$tmp/random.bin"
+printf '\000\000\000' >> "$tmp/random.bin"
+"$disassembler" -t 1 "$tmp/random.bin" > "$tmp/random.lst"
+for threads in 2 3 8; do
+    "$disassembler" -t $threads "$tmp/random.bin" 2> /dev/null | cmp -s - "$tmp/random.lst" || fail "-t $threads listing"
+done
+
+# I80R: records written with --format bin list the same text with --from-bin
+"$disassembler" --format bin "$image" > "$tmp/opcodes.rec" || fail "--format bin"
+[ "$(head -c 4 "$tmp/opcodes.rec")" = I80R ] || fail "I80R magic"
+"$disassembler" --from-bin "$tmp/opcodes.rec" | cmp -s - "$dir/opcodes.lst" || fail "I80R round trip"
+"$disassembler" -r --format bin "$tmp/flow.bin" > "$tmp/flow.rec"
+"$disassembler" --from-bin "$tmp/flow.rec" | cmp -s - "$tmp/flow.lst" || fail "I80R round trip of data records"
+"$disassembler" --from-bin "$image" 2> /dev/null && fail "--from-bin of a file that is not records"
+
+# a pipe is listed as it arrives, the same as the file
+for file in "$image" "$tmp/tail.bin" "$tmp/random.bin"; do
+    "$disassembler" "$file" > "$tmp/file.lst" 2> /dev/null
+    cat "$file" | "$disassembler" - 2> /dev/null | cmp -s - "$tmp/file.lst" || fail "piped $file"
+done
+cat "$tmp/flow.bin" | "$disassembler" -r - | cmp -s - "$tmp/flow.lst" || fail "piped recursive listing"
+
+# the benchmark times every stage of each mix and cleans up after itself
+mkdir "$tmp/bench"
+for mix in uniform code operand; do
+    TMPDIR=$tmp/bench "$disassembler" --bench --bench-mix $mix --bench-size 4096 --bench-iters 2 > "$tmp/bench.txt" \
+        || fail "--bench-mix $mix"
+    for stage in load decode format sweep; do
+        grep -q "^$stage " "$tmp/bench.txt" || fail "--bench-mix $mix has no $stage stage"
+    done
+done
+[ -z "$(ls "$tmp/bench")" ] || fail "--bench left its input behind"
+
+# labels name every target; a symbol file names them instead, in any of
+# its three spellings
+printf 'main EQU 0006\n; comment\nhelper = 0x000b\n' > "$tmp/flow.sym"
+cat > "$tmp/labels.lst" <<'END'
+0000: JMP	L0006
+0003: DB	ff,ff,ff
+L0006:
+0006: CALL	L000b
+0009: HLT
+000a: DB	ff
+L000b:
+000b: MVI	A,01
+000d: RET
+END
+cat > "$tmp/symbols.lst" <<'END'
+0000: JMP	main
+0003: RST	7
+0004: RST	7
+0005: RST	7
+main:
+0006: CALL	helper
+0009: HLT
+000a: RST	7
+helper:
+000b: MVI	A,01
+000d: RET
+END
+"$disassembler" -r --labels "$tmp/flow.bin" | cmp -s - "$tmp/labels.lst" || fail "recursive listing with labels"
+"$disassembler" --labels --symbols "$tmp/flow.sym" "$tmp/flow.bin" | cmp -s - "$tmp/symbols.lst" || fail "symbols"
+"$disassembler" --symbols "$tmp/missing.sym" "$tmp/flow.bin" > /dev/null 2>&1 && fail "missing symbol file"
+
+# the library on its own lists what the disassembler does
+"$listlib" "$image" | cmp -s - "$dir/opcodes.lst" || fail "library listing"
+"$listlib" "$tmp/tail.bin" | cmp -s - "$tmp/tail.lst" || fail "library listing past the image end"
+"$listlib" "$tmp/random.bin" | cmp -s - "$tmp/random.lst" || fail "library listing of random bytes"
+
+# I80C: a rerun comes from the cache, a patched image reuses what it can
+"$disassembler" --cache "$tmp/cache" "$image" 2> /dev/null | cmp -s - "$dir/opcodes.lst" || fail "I80C first run"
+[ "$(head -c 4 "$tmp/cache")" = I80C ] || fail "I80C magic"
+"$disassembler" --cache "$tmp/cache" "$image" 2> "$tmp/err" | cmp -s - "$dir/opcodes.lst" || fail "I80C rerun"
+grep -q "cache hit" "$tmp/err" || fail "I80C rerun missed the cache"
+cp "$image" "$tmp/patched.bin"
+printf '\303' | dd of="$tmp/patched.bin" bs=1 seek=100 conv=notrunc 2> /dev/null
+"$disassembler" "$tmp/patched.bin" > "$tmp/patched.lst"
+"$disassembler" --cache "$tmp/cache" "$tmp/patched.bin" 2> "$tmp/err" | cmp -s - "$tmp/patched.lst" \
+    || fail "I80C patched image"
+grep -q "reused [1-9]" "$tmp/err" || fail "I80C patched image reused nothing"
+
+# every opcode in each syntax; intel is the default listing
+"$disassembler" --syntax intel "$image" | cmp -s - "$dir/opcodes.lst" || fail "intel listing"
+"$disassembler" --syntax z80 "$image" | cmp -s - "$dir/opcodes.z80.lst" || fail "z80 listing"
+"$disassembler" --syntax asm "$image" | cmp -s - "$dir/opcodes.asm.lst" || fail "asm listing"
+
+# banks: each one is listed as its own image at the base it is mapped at
+printf '0x80=0x8000\n0x100 0xc000\n' > "$tmp/banks.map"
+"$disassembler" --bank-size 0x80 --bank 0=0x2000 --bank-map "$tmp/banks.map" "$image" > "$tmp/banks.lst" \
+    || fail "banked listing"
+: > "$tmp/banks.expected"
+for bank in 0:2000 1:8000 2:c000; do
+    index=${bank%:*}
+    base=${bank#*:}
+    dd if="$image" of="$tmp/bank.bin" bs=128 skip=$index count=1 2> /dev/null
+    echo "; bank $index at $base, file offset $(printf %x $((index * 128)))" >> "$tmp/banks.expected"
+    "$listlib" "$tmp/bank.bin" 0x$base >> "$tmp/banks.expected"
+done
+cmp -s "$tmp/banks.lst" "$tmp/banks.expected" || fail "banked listing"
+cat "$image" | "$disassembler" --bank-size 0x80 --bank 0=0x2000 --bank-map "$tmp/banks.map" - \
+    | cmp -s - "$tmp/banks.lst" || fail "piped banked listing"
+# twice the cpu memory is 8 banks of 16 KiB
+cat "$tmp/random.bin" "$tmp/random.bin" > "$tmp/big.bin"
+"$disassembler" --bank-size 0x4000 -f 0x4000 "$tmp/big.bin" > "$tmp/big.lst" || fail "image bigger than the cpu memory"
+[ "$(grep -c '^; bank' "$tmp/big.lst")" = 8 ] || fail "banks of a 128 KiB image"
+
+# --stats leaves the listing alone and counts every opcode once
+"$disassembler" --stats "$image" 2> "$tmp/stats.json" | cmp -s - "$dir/opcodes.lst" || fail "listing with --stats"
+grep -q '"instructions": 256,' "$tmp/stats.json" && grep -q '"undocumented": 12,' "$tmp/stats.json" \
+    && [ "$(grep -c '^    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,\{0,1\}$' "$tmp/stats.json")" = 16 ] \
+    || fail "--stats counts"
+"$disassembler" --stats -t 4 "$tmp/random.bin" 2> "$tmp/stats.json" > /dev/null
+grep -q '"bytes_decoded": 65536,' "$tmp/stats.json" || fail "--stats on threads"
+
+# a worker reuses one arena for file after file; nothing may leak from one
+# listing into the next
+mkdir "$tmp/arena" "$tmp/arena.in"
+for name in a b c d e f; do
+    cp "$tmp/flow.bin" "$tmp/arena.in/$name.bin"
+done
+cp "$image" "$tmp/arena.in/c.bin"
+cp "$tmp/random.bin" "$tmp/arena.in/e.bin"
+"$disassembler" -t 2 -r --labels -d "$tmp/arena" "$tmp/arena.in"/*.bin 2> /dev/null || fail "batch with labels"
+for file in "$tmp/arena.in"/*.bin; do
+    "$disassembler" -r --labels "$file" | cmp -s - "$tmp/arena/${file##*/}.lst" || fail "batch with labels, $file"
+done
+
+# I80X: a saved index answers queries the way it did
+"$disassembler" --xref-out "$tmp/opcodes.idx" "$image" | cmp -s - "$dir/opcodes.lst" || fail "listing with --xref-out"
+[ "$(head -c 4 "$tmp/opcodes.idx")" = I80X ] || fail "I80X magic"
+"$disassembler" --xref 0x1234 --xref 0x0006 "$tmp/opcodes.idx" | cmp -s - "$dir/opcodes.xref" || fail "I80X query"
+"$disassembler" -r --xref-out "$tmp/flow.idx" "$tmp/flow.bin" > /dev/null || fail "--xref-out of a traversal"
+cat > "$tmp/flow.xref" <<'END'
+; 0006: 1 reference, 1 jump
+0000: JMP	0006
+; 000b: 1 reference, 1 call
+0006: CALL	000b
+END
+"$disassembler" --xref 6 --xref 0xb "$tmp/flow.idx" | cmp -s - "$tmp/flow.xref" || fail "I80X query of a traversal"
+
+# a listing at an offset ends with the image, at the library's base too
+"$listlib" "$image" 0x100 > "$tmp/offset.lst"
+"$disassembler" -f 0x100 "$image" | cmp -s - "$tmp/offset.lst" || fail "listing at an offset"
+
+# ranges are the lines of the whole listing that start inside them, and
+# --count cuts each one short
+between() {
+    awk -v lo="$2:" -v hi="$3:" '$1 >= lo && $1 < hi' "$1"
+}
+between "$dir/opcodes.lst" 0041 0050 > "$tmp/range.lst"
+between "$dir/opcodes.lst" 0142 0200 >> "$tmp/range.lst"
+"$disassembler" --range 0x41:0x50 --range 0x140:0x200 "$image" | cmp -s - "$tmp/range.lst" || fail "--range"
+between "$dir/opcodes.lst" 0041 0048 > "$tmp/count.lst"
+"$disassembler" --range 0x41: --count 3 "$image" | cmp -s - "$tmp/count.lst" || fail "--range with --count"
+"$disassembler" -j 0x41 --count 3 "$image" | cmp -s - "$tmp/count.lst" || fail "--count from the jump point"
+# in random bytes the range must find the boundary the full sweep has
+between "$tmp/random.lst" 8000 8100 > "$tmp/range.lst"
+"$disassembler" --range 0x8000:0x8100 "$tmp/random.bin" | cmp -s - "$tmp/range.lst" || fail "--range in random bytes"
+between "$tmp/flow.lst" 0006 000c > "$tmp/range.lst"
+"$disassembler" -r --range 0x6:0xc "$tmp/flow.bin" | cmp -s - "$tmp/range.lst" || fail "--range of a traversal"
+
+# --emit renders one decode as each format would have been written alone
+"$disassembler" --emit text="$tmp/emit.lst" --emit json="$tmp/emit.json" --emit bin="$tmp/emit.rec" "$image" \
+    || fail "--emit"
+cmp -s "$tmp/emit.lst" "$dir/opcodes.lst" || fail "--emit text"
+cmp -s "$tmp/emit.rec" "$tmp/opcodes.rec" || fail "--emit bin"
+sed 's/.*"text":"\(.*\)"}$/\1/; s/\\t/	/' "$tmp/emit.json" > "$tmp/emit.text"
+cut -d' ' -f2- "$dir/opcodes.lst" | cmp -s - "$tmp/emit.text" || fail "--emit json"
+"$disassembler" -r --emit text="$tmp/emit.lst" --emit bin="$tmp/emit.rec" "$tmp/flow.bin" || fail "--emit of a traversal"
+cmp -s "$tmp/emit.lst" "$tmp/flow.lst" && cmp -s "$tmp/emit.rec" "$tmp/flow.rec" || fail "--emit of a traversal"
+# the bin count is patched at the end, so a pipe gets nothing at all
+"$disassembler" --emit bin=- "$image" > "$tmp/emit.rec" && cmp -s "$tmp/emit.rec" "$tmp/opcodes.rec" \
+    || fail "--emit bin to stdout"
+("$disassembler" --emit bin=- "$image" 2> /dev/null && echo ok) | wc -c | grep -qx ' *0' \
+    || fail "--emit bin to a pipe"
+# --emit takes the place of -o, which is refused before it truncates anything
+echo kept > "$tmp/emit.out"
+"$disassembler" -o "$tmp/emit.out" --emit text="$tmp/emit.lst" "$image" 2> /dev/null && fail "-o with --emit"
+grep -qx kept "$tmp/emit.out" || fail "-o with --emit truncated its file"
+
+# --pc-trace: only what the emulator ran is code, from either trace format,
+# a pipe, or a trace big enough to be read on several threads
+cat > "$tmp/trace.lst" <<'END'
+0000: JMP	0600
+0003: DB	ff,ff,ff
+0006: CALL	0b00
+0009: HLT
+000a: DB	ff,3e,01,c9
+END
+printf '0000 JMP\n0006\n0009 halt\n' > "$tmp/trace.txt"
+printf '\000\000\006\000\011\000' > "$tmp/trace.bin"
+"$disassembler" --pc-trace "$tmp/trace.bin" "$tmp/flow.bin" | cmp -s - "$tmp/trace.lst" || fail "bin trace"
+"$disassembler" --pc-trace "$tmp/trace.txt" --trace-format text "$tmp/flow.bin" | cmp -s - "$tmp/trace.lst" \
+    || fail "text trace"
+cat "$tmp/trace.bin" | "$disassembler" --pc-trace - "$tmp/flow.bin" | cmp -s - "$tmp/trace.lst" || fail "piped trace"
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19; do
+    cat "$tmp/trace.txt" "$tmp/trace.txt" > "$tmp/trace.tmp"
+    mv "$tmp/trace.tmp" "$tmp/trace.txt"
+done
+"$disassembler" -t 4 --pc-trace "$tmp/trace.txt" --trace-format text "$tmp/flow.bin" 2> /dev/null \
+    | cmp -s - "$tmp/trace.lst" || fail "text trace on threads"
+
+# I80G: the graph of every opcode is the one saved, and a traversal's
+# graph has its call, fall-through and jump edges
+"$disassembler" --cfg-bin "$tmp/opcodes.cfg" "$image" | cmp -s - "$dir/opcodes.lst" || fail "listing with --cfg-bin"
+cmp -s "$tmp/opcodes.cfg" "$dir/opcodes.cfg" || fail "I80G graph"
+cat > "$tmp/flow.dot" <<'END'
+digraph cfg {
+    node [shape=box, fontname="monospace"];
+    b0 [label="0000-0002\n1 insn"];
+    b6 [label="0006-0008\n1 insn"];
+    b9 [label="0009-0009\n1 insn"];
+    bb [label="000b-000d\n2 insns"];
+    b0 -> b6 [];
+    b6 -> b9 [style=dashed];
+    b6 -> bb [color=blue];
+}
+END
+"$disassembler" -r --cfg-dot "$tmp/cfg.dot" "$tmp/flow.bin" > /dev/null && cmp -s "$tmp/cfg.dot" "$tmp/flow.dot" \
+    || fail "--cfg-dot of a traversal"
+
+# --data finds the string, the fill runs and the jump table of data.bin
+"$disassembler" --data "$dir/data.bin" | cmp -s - "$dir/data.lst" || fail "--data listing"
+"$disassembler" --data --syntax asm "$dir/data.bin" | cmp -s - "$dir/data.asm.lst" || fail "--data asm listing"
+
+# the asm listing, linear or recursive, assembles back to the image byte
+# for byte, and so does the plain listing in asm syntax
+for file in "$image" "$tmp/flow.bin" "$tmp/random.bin" "$dir/data.bin"; do
+    "$disassembler" --asm "$file" | "$disassembler" --assemble - | cmp -s - "$file" || fail "--asm of $file"
+    "$disassembler" --asm -r "$file" | "$disassembler" --assemble - | cmp -s - "$file" || fail "--asm -r of $file"
+    "$disassembler" --verify -r "$file" || fail "--verify of $file"
+done
+"$disassembler" --syntax asm "$image" | "$disassembler" --assemble - | cmp -s - "$image" || fail "asm syntax listing"
+printf '\tJMP\tnowhere\n' | "$disassembler" --assemble - > /dev/null 2>&1 && fail "--assemble of an undefined name"
+
+# I80L: a batch through the listing cache, cold and warm, matches one
+# without it, and a damaged entry is rebuilt rather than served
+mkdir "$tmp/lcache.in" "$tmp/lcache.plain" "$tmp/lcache.cold" "$tmp/lcache.warm" "$tmp/lcache.damaged"
+cp "$image" "$tmp/lcache.in/a.bin"
+cp "$tmp/patched.bin" "$tmp/lcache.in/b.bin"
+cp "$tmp/random.bin" "$tmp/lcache.in/c.bin"
+"$disassembler" -d "$tmp/lcache.plain" "$tmp/lcache.in"/*.bin 2> /dev/null || fail "batch"
+for run in cold warm; do
+    "$disassembler" --cache-dir "$tmp/listings" -d "$tmp/lcache.$run" "$tmp/lcache.in"/*.bin 2> /dev/null \
+        && diff -r "$tmp/lcache.plain" "$tmp/lcache.$run" > /dev/null || fail "I80L $run batch"
+done
+[ "$(ls "$tmp/listings" | grep -c '^[0-9a-f]\{32\}$')" = 3 ] || fail "I80L entries"
+for entry in "$tmp/listings"/*; do
+    [ "$(head -c 4 "$entry")" = I80L ] || fail "I80L magic"
+    printf 'x' | dd of="$entry" bs=1 seek=40 conv=notrunc 2> /dev/null
+done
+"$disassembler" --cache-dir "$tmp/listings" -d "$tmp/lcache.damaged" "$tmp/lcache.in"/*.bin 2> /dev/null \
+    && diff -r "$tmp/lcache.plain" "$tmp/lcache.damaged" > /dev/null || fail "I80L damaged entries"
+
+# labels survive a pipe, and numbers with anything after them are refused
+cat "$tmp/flow.bin" | "$disassembler" -r --labels - | cmp -s - "$tmp/labels.lst" || fail "piped listing with labels"
+for number in 12q 0x10z 99! 10hh; do
+    "$disassembler" --range $number:0x20 "$tmp/flow.bin" > /dev/null 2>&1 && fail "--range $number"
+done
+"$disassembler" --range 6h:0ch -r "$tmp/flow.bin" | cmp -s - "$tmp/range.lst" || fail "--range in h notation"
+
+# --xref-out and every other option still work on piped input
+cat "$image" | "$disassembler" --xref-out "$tmp/piped.idx" - | cmp -s - "$dir/opcodes.lst" || fail "piped --xref-out"
+cmp -s "$tmp/piped.idx" "$tmp/opcodes.idx" || fail "piped I80X index"
+for options in "-r" "--syntax z80" "-j 5" "--data" "--count 5" "--range 0x40:0x60" "--asm" "-t 3"; do
+    "$disassembler" $options "$tmp/random.bin" > "$tmp/file.lst" 2> /dev/null
+    cat "$tmp/random.bin" | "$disassembler" $options - 2> /dev/null | cmp -s - "$tmp/file.lst" || fail "piped $options"
+done
+
+# two inputs with one name would overwrite each other's listing; a batch
+# to stdout that cannot be written fails
+mkdir "$tmp/clash" "$tmp/clash/a" "$tmp/clash/b" "$tmp/clash/out"
+cp "$tmp/flow.bin" "$tmp/clash/a/x.bin"
+cp "$image" "$tmp/clash/b/x.bin"
+"$disassembler" -d "$tmp/clash/out" "$tmp/clash/a/x.bin" "$tmp/clash/b/x.bin" 2> /dev/null && fail "clashing names"
+[ -z "$(ls "$tmp/clash/out")" ] || fail "clashing names wrote a listing"
+if [ -w /dev/full ]; then
+    "$disassembler" -b "$image" "$tmp/flow.bin" > /dev/full 2> /dev/null && fail "batch to a full device"
+fi
+
+# a range of a banked image lists only the part of the bank it names,
+# and --count counts instructions, not the data between them
+dd if="$tmp/big.bin" of="$tmp/bank.bin" bs=16384 skip=5 count=1 2> /dev/null
+"$listlib" "$tmp/bank.bin" 0x4000 > "$tmp/bank.lst"
+echo "; bank 5 at 4000, file offset 14000" > "$tmp/range.lst"
+between "$tmp/bank.lst" 5000 5100 >> "$tmp/range.lst"
+"$disassembler" --bank-size 0x4000 -f 0x4000 --range 5:0x5000:0x5100 "$tmp/big.bin" | cmp -s - "$tmp/range.lst" \
+    || fail "--range in a bank"
+cat "$tmp/big.bin" | "$disassembler" --bank-size 0x4000 -f 0x4000 --range 5:0x5000:0x5100 - \
+    | cmp -s - "$tmp/range.lst" || fail "--range in a piped bank"
+"$disassembler" --range 5:0x5000:0x5100 "$tmp/random.bin" > /dev/null 2>&1 && fail "a bank in a range without --bank"
+between "$tmp/flow.lst" 0000 000a > "$tmp/count.lst"
+"$disassembler" -r --count 3 "$tmp/flow.bin" | cmp -s - "$tmp/count.lst" || fail "--count of a traversal"
+
+# a traced jump cut short by the end of a 4 KiB image is data, not an
+# instruction with operands from past the end
+dd if=/dev/zero of="$tmp/cut.bin" bs=1 count=4095 2> /dev/null
+printf '\303' >> "$tmp/cut.bin"
+printf '\377\017' > "$tmp/cut.trace"
+[ "$("$disassembler" --pc-trace "$tmp/cut.trace" "$tmp/cut.bin" | tail -n 1)" = "0ff8: DB	00,00,00,00,00,00,00,c3" ] \
+    || fail "traced instruction past the image end"
+
+# the data listing in asm syntax assembles back too, fills and all
+"$disassembler" --data --syntax asm "$dir/data.bin" | "$disassembler" --assemble - | cmp -s - "$dir/data.bin" \
+    || fail "--data asm listing round trip"
+
+[ $failed = 0 ] && echo "all checks passed"
+exit $failed
@@ -0,0 +1,88 @@
+/* list an image through the library alone, the way another program
+ * would use it: DisasmRange() writes the listing to stdout, and the
+ * same text is built again from DecodeRange() and FormatInsn() to check
+ * that the two agree. The length prepass is checked against its table
+ * on the way
+ *
+ * usage: listlib IMAGE [BASE] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../disasm8080.h"
+
+typedef struct {
+    char* text;
+    size_t len;
+    size_t cap;
+} Text;
+
+static int Append(void* user, const char* text, size_t len) {
+    Text* t = user;
+    if (t->len + len > t->cap) {
+        const size_t cap = (t->len + len) * 2;
+        char* grown = realloc(t->text, cap);
+        if (!grown)
+            return -1;
+        t->text = grown;
+        t->cap = cap;
+    }
+    memcpy(t->text + t->len, text, len);
+    t->len += len;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s IMAGE [BASE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    static uint8_t image[0x10000];
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    const size_t size = fread(image, 1, sizeof(image), f);
+    fclose(f);
+    const size_t base = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+
+    /* from every offset into the first 32 bytes */
+    static uint8_t attrs[sizeof(image)];
+    for (size_t skip = 0; skip <= 32 && skip <= size; ++skip) {
+        ClassifyBytes(image + skip, size - skip, attrs);
+        for (size_t i = 0; skip + i < size; ++i) {
+            if (attrs[i] != disasm_attrs[image[skip + i]]) {
+                fprintf(stderr, "%s: ClassifyBytes disagrees with the table at %zu\n", argv[0], skip + i);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    Text listed = {0};
+    const DisasmContext ctx = {.data = image, .size = size, .base = base, .write = Append, .user = &listed};
+    if (DisasmRange(&ctx, base, base + size) != 0) {
+        fprintf(stderr, "%s: DisasmRange failed\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* a few records at a time, so every call starts where the last ended */
+    Text decoded = {0};
+    Insn insns[7];
+    for (size_t address = base; address < base + size;) {
+        const size_t n = DecodeRange(&ctx, address, base + size, insns, 7, &address);
+        for (size_t i = 0; i < n; ++i) {
+            char line[DISASM_LINE_MAX];
+            if (Append(&decoded, line, FormatInsn(line, &insns[i])) < 0)
+                return EXIT_FAILURE;
+        }
+    }
+    if (decoded.len != listed.len || (listed.len && memcmp(decoded.text, listed.text, listed.len))) {
+        fprintf(stderr, "%s: DecodeRange and DisasmRange disagree\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    fwrite(listed.text, 1, listed.len, stdout);
+    free(listed.text);
+    free(decoded.text);
+    return EXIT_SUCCESS;
+}